@@ -51,6 +51,13 @@ namespace socklib {
             return !canceled;
         }
 
+        //milliseconds until this context is canceled by deadline
+        //-1 means no deadline
+        virtual long long remaining_msec() const {
+            if (parent) return parent->remaining_msec();
+            return -1;
+        }
+
         CancelReason reason() const {
             return reason_;
         }
@@ -84,8 +91,8 @@ namespace socklib {
             err = WSAGetLastError();
             bool block = err == WSAEWOULDBLOCK;
 #else
-            bool block = err == EAGAIN;
             err = errno;
+            bool block = err == EAGAIN || err == EWOULDBLOCK;
 #endif
             if (cancel_when_block && block) {
                 reason_ = CancelReason::blocking;
@@ -99,6 +106,13 @@ namespace socklib {
             }
             return false;
         }
+
+        //cancel as blocking without checking os error
+        //used when blocking is detected by other than errno (e.g. send queue is full)
+        void cancel_by_block() {
+            reason_ = CancelReason::blocking;
+            canceled = true;
+        }
     };
 
     struct SSLErrorContext : OsErrorContext {
@@ -181,6 +195,14 @@ namespace socklib {
             return true;
         }
 
+        virtual long long remaining_msec() const override {
+            long long rem = ((long long)begintime + timeout - std::time(nullptr) + 1) * 1000;
+            if (rem < 0) rem = 0;
+            auto p = CancelContext::remaining_msec();
+            if (p >= 0 && p < rem) return p;
+            return rem;
+        }
+
         bool reset(time_t t) {
             if (t < 0) return false;
             timeout = t;
@@ -0,0 +1,130 @@
+/*
+    socklib - simple socket library
+    Copyright (c) 2021 on-keyday (https://github.com/on-keyday)
+    Released under the MIT license
+    https://opensource.org/licenses/mit-license.php
+*/
+
+#pragma once
+
+#include "cancel.h"
+
+#ifndef _WIN32
+#include <poll.h>
+#endif
+
+namespace socklib {
+    enum class WaitResult {
+        ready,
+        timeout,
+        failed,
+        canceled,
+    };
+
+    //upper bound of one blocking wait so that flag based CancelContext (like InterruptContext) is still observed
+    constexpr int io_wait_slice_msec = 100;
+
+#ifdef _WIN32
+    using pollfd_t = ::WSAPOLLFD;
+#else
+    using pollfd_t = ::pollfd;
+#endif
+
+    //poll fds at most msec milliseconds
+    //returns count of ready fds, 0 if timeout, -1 if failed
+    inline int poll_fds(pollfd_t* fds, size_t count, int msec) {
+#ifdef _WIN32
+        return ::WSAPoll(fds, (ULONG)count, msec);
+#else
+        int res = 0;
+        do {
+            res = ::poll(fds, (::nfds_t)count, msec);
+        } while (res < 0 && errno == EINTR);
+        return res;
+#endif
+    }
+
+    //wait at most msec milliseconds until sock is readable or writable
+    inline WaitResult wait_io_once(SOCKET sock, bool write, int msec) {
+        pollfd_t fd = {0};
+        fd.fd = sock;
+        fd.events = write ? POLLOUT : POLLIN;
+        auto res = poll_fds(&fd, 1, msec);
+        if (res < 0) {
+            return WaitResult::failed;
+        }
+        if (res == 0) {
+            return WaitResult::timeout;
+        }
+        if (fd.revents & POLLNVAL) {
+            return WaitResult::failed;
+        }
+        return WaitResult::ready;
+    }
+
+    //block until sock is readable or writable, or cancel is canceled
+    //deadline of cancel (see CancelContext::remaining_msec) is used as poll timeout
+    inline WaitResult wait_io(SOCKET sock, bool write, CancelContext* cancel = nullptr) {
+        while (true) {
+            int msec = io_wait_slice_msec;
+            if (cancel) {
+                auto rem = cancel->remaining_msec();
+                if (rem >= 0 && rem < msec) {
+                    msec = (int)rem;
+                }
+            }
+            auto res = wait_io_once(sock, write, msec);
+            if (res != WaitResult::timeout) {
+                return res;
+            }
+            if (cancel && cancel->on_cancel()) {
+                return WaitResult::canceled;
+            }
+        }
+    }
+
+    //get result of non-blocking connect after sock became writable
+    //returns 0 if connected
+    inline int connect_error(SOCKET sock) {
+        int err = 0;
+        ::socklen_t len = sizeof(err);
+        if (::getsockopt(sock, SOL_SOCKET, SO_ERROR, (char*)&err, &len) < 0) {
+#ifdef _WIN32
+            return ::WSAGetLastError();
+#else
+            return errno;
+#endif
+        }
+        return err;
+    }
+
+    //whether ::connect() on non-blocking socket returned because connection is in progress
+    inline bool connect_in_progress() {
+#ifdef _WIN32
+        return ::WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+        return errno == EINPROGRESS;
+#endif
+    }
+
+    //whether last send()/recv() on non-blocking socket failed because it would block
+    inline bool io_would_block() {
+#ifdef _WIN32
+        return ::WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+        return errno == EAGAIN || errno == EWOULDBLOCK;
+#endif
+    }
+
+    //wait until non-blocking connect is completed
+    inline WaitResult wait_connect(SOCKET sock, CancelContext* cancel = nullptr) {
+        auto res = wait_io(sock, true, cancel);
+        if (res != WaitResult::ready) {
+            return res;
+        }
+        if (connect_error(sock) != 0) {
+            return WaitResult::failed;
+        }
+        return WaitResult::ready;
+    }
+}  // namespace socklib
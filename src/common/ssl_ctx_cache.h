@@ -0,0 +1,204 @@
+/*
+    socklib - simple socket library
+    Copyright (c) 2021 on-keyday (https://github.com/on-keyday)
+    Released under the MIT license
+    https://opensource.org/licenses/mit-license.php
+*/
+
+#pragma once
+
+#include "platform.h"
+#include "ssl_session_cache.h"
+#include "ssl_ticket_keys.h"
+
+#include <mutex>
+#include <map>
+#include <string>
+
+namespace socklib {
+#if USE_OPENSSL
+    enum class SSLCtxError {
+        none,
+        memory,
+        cacert,
+        certificate,
+    };
+
+    //SSLCtxCache - process wide cache of SSL_CTX
+    //client SSL_CTX is shared by connections of same (cacert, ALPN, verify mode)
+    //so that CA bundle is parsed once instead of on each connection
+    //server SSL_CTX is shared by acceptors of same (certificate, private key, ALPN, ticket rotation)
+    struct SSLCtxCache {
+        static SSLCtxCache& instance() {
+            static SSLCtxCache inst;
+            return inst;
+        }
+
+        //returns SSL_CTX with new reference which caller must release by ::SSL_CTX_free
+        //returned SSL_CTX must not be modified because other connections share it
+        //returns nullptr and set err if failed
+        ::SSL_CTX* get(const char* cacert, const char* alpn, size_t alpnlen, int verify_mode, SSLCtxError* err = nullptr) {
+            std::string key;
+            if (cacert) {
+                key += '1';
+                key += cacert;
+            }
+            key += '\0';
+            if (alpn) {
+                key.append(alpn, alpnlen);
+            }
+            key += '\0';
+            key += std::to_string(verify_mode);
+            return lookup(std::move(key), [&] {
+                return make_ctx(cacert, alpn, alpnlen, verify_mode, err);
+            });
+        }
+
+        //server SSL_CTX with certificate chain of cert and private key of key
+        //ALPN protocol is selected by server preference order of alpn (wire format)
+        //session tickets are stateless and their keys are rotated every ticket_rotation_sec (see SSLTicketKeys)
+        //returns SSL_CTX with new reference which caller must release by ::SSL_CTX_free
+        ::SSL_CTX* get_server(const char* cert, const char* privkey, const char* alpn, size_t alpnlen,
+                              std::uint32_t ticket_rotation_sec = 3600, SSLCtxError* err = nullptr) {
+            std::string key = "S";
+            key += cert;
+            key += '\0';
+            key += privkey;
+            key += '\0';
+            if (alpn) {
+                key.append(alpn, alpnlen);
+            }
+            key += '\0';
+            key += std::to_string(ticket_rotation_sec);
+            return lookup(std::move(key), [&] {
+                return make_server_ctx(cert, privkey, alpn, alpnlen, ticket_rotation_sec, err);
+            });
+        }
+
+        //drop cached SSL_CTX (for example after CA bundle file is updated)
+        //connections still holding them are not affected
+        void clear() {
+            std::lock_guard<std::mutex> guard(lock);
+            for (auto& c : ctxs) {
+                ::SSL_CTX_free(c.second);
+            }
+            ctxs.clear();
+        }
+
+        ~SSLCtxCache() {
+            clear();
+        }
+
+       private:
+        std::mutex lock;
+        std::map<std::string, ::SSL_CTX*> ctxs;
+
+        SSLCtxCache() {}
+
+        template <class Make>
+        ::SSL_CTX* lookup(std::string&& key, Make&& make) {
+            std::lock_guard<std::mutex> guard(lock);
+            auto found = ctxs.find(key);
+            if (found == ctxs.end()) {
+                auto sslctx = make();
+                if (!sslctx) {
+                    return nullptr;
+                }
+                found = ctxs.emplace(std::move(key), sslctx).first;
+            }
+            ::SSL_CTX_up_ref(found->second);
+            return found->second;
+        }
+
+        //owned by server SSL_CTX
+        struct ServerData {
+            std::string alpn;
+            SSLTicketKeys keys;
+        };
+
+        static void free_server_data(void*, void* ptr, ::CRYPTO_EX_DATA*, int, long, void*) {
+            delete (ServerData*)ptr;
+        }
+
+        static int server_data_index() {
+            static int index = ::SSL_CTX_get_ex_new_index(0, nullptr, nullptr, nullptr, free_server_data);
+            return index;
+        }
+
+        static int select_alpn(::SSL*, const unsigned char** out, unsigned char* outlen,
+                               const unsigned char* in, unsigned int inlen, void* arg) {
+            auto data = (ServerData*)arg;
+            unsigned char* selected = nullptr;
+            if (::SSL_select_next_proto(&selected, outlen, (const unsigned char*)data->alpn.data(), (unsigned int)data->alpn.size(), in, inlen) != OPENSSL_NPN_NEGOTIATED) {
+                return SSL_TLSEXT_ERR_NOACK;
+            }
+            *out = selected;
+            return SSL_TLSEXT_ERR_OK;
+        }
+
+        static ::SSL_CTX* make_server_ctx(const char* cert, const char* privkey, const char* alpn, size_t alpnlen,
+                                          std::uint32_t ticket_rotation_sec, SSLCtxError* err) {
+            auto set_err = [&](SSLCtxError e) {
+                if (err) {
+                    *err = e;
+                }
+            };
+            auto sslctx = ::SSL_CTX_new(::TLS_server_method());
+            if (!sslctx) {
+                set_err(SSLCtxError::memory);
+                return nullptr;
+            }
+            if (::SSL_CTX_use_certificate_chain_file(sslctx, cert) != 1 ||
+                ::SSL_CTX_use_PrivateKey_file(sslctx, privkey, SSL_FILETYPE_PEM) != 1 ||
+                ::SSL_CTX_check_private_key(sslctx) != 1) {
+                ::SSL_CTX_free(sslctx);
+                set_err(SSLCtxError::certificate);
+                return nullptr;
+            }
+            auto data = new ServerData();
+            if (!::SSL_CTX_set_ex_data(sslctx, server_data_index(), data)) {
+                delete data;
+                ::SSL_CTX_free(sslctx);
+                set_err(SSLCtxError::memory);
+                return nullptr;
+            }
+            if (alpn && alpnlen) {
+                data->alpn.assign(alpn, alpnlen);
+                ::SSL_CTX_set_alpn_select_cb(sslctx, select_alpn, data);
+            }
+            //resumption is done only by tickets, so server keeps no session state
+            ::SSL_CTX_set_session_cache_mode(sslctx, SSL_SESS_CACHE_OFF);
+            data->keys.rotation_sec = ticket_rotation_sec;
+            SSLTicketKeys::install(sslctx, &data->keys);
+            return sslctx;
+        }
+
+        static ::SSL_CTX* make_ctx(const char* cacert, const char* alpn, size_t alpnlen, int verify_mode, SSLCtxError* err) {
+            auto set_err = [&](SSLCtxError e) {
+                if (err) {
+                    *err = e;
+                }
+            };
+            auto sslctx = ::SSL_CTX_new(::TLS_method());
+            if (!sslctx) {
+                set_err(SSLCtxError::memory);
+                return nullptr;
+            }
+            ::SSL_CTX_set_options(sslctx, SSL_OP_NO_SSLv2);
+            SSLSessionCache::enable(sslctx);
+            ::SSL_CTX_set_verify(sslctx, verify_mode, nullptr);
+            if (cacert) {
+                if (!::SSL_CTX_load_verify_locations(sslctx, cacert, nullptr)) {
+                    ::SSL_CTX_free(sslctx);
+                    set_err(SSLCtxError::cacert);
+                    return nullptr;
+                }
+            }
+            if (alpn && alpnlen) {
+                ::SSL_CTX_set_alpn_protos(sslctx, (const unsigned char*)alpn, (unsigned int)alpnlen);
+            }
+            return sslctx;
+        }
+    };
+#endif
+}  // namespace socklib
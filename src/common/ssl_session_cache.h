@@ -0,0 +1,160 @@
+/*
+    socklib - simple socket library
+    Copyright (c) 2021 on-keyday (https://github.com/on-keyday)
+    Released under the MIT license
+    https://opensource.org/licenses/mit-license.php
+*/
+
+#pragma once
+
+#include "platform.h"
+
+#include <mutex>
+#include <map>
+#include <deque>
+#include <string>
+#include <atomic>
+
+namespace socklib {
+#if USE_OPENSSL
+    //SSLSessionCache - process wide cache of client TLS sessions
+    //sessions (and TLS 1.3 tickets) received on connection are stored by its key (host:port of SNI)
+    //and set to next connection of same key so that it does abbreviated handshake
+    struct SSLSessionCache {
+        static SSLSessionCache& instance() {
+            static SSLSessionCache inst;
+            return inst;
+        }
+
+        //sessions kept for each key
+        size_t max_per_key = 4;
+
+        //make sslctx store sessions into this cache (see SSLCtxCache)
+        static void enable(::SSL_CTX* sslctx) {
+            ::SSL_CTX_set_session_cache_mode(sslctx, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+            ::SSL_CTX_sess_set_new_cb(sslctx, on_new_session);
+        }
+
+        //bind ssl to key and set cached session of key before SSL_connect
+        //returns true if session is set
+        bool apply(::SSL* ssl, const std::string& key) {
+            auto index = key_index();
+            delete (std::string*)::SSL_get_ex_data(ssl, index);
+            auto bound = new std::string(key);
+            if (!::SSL_set_ex_data(ssl, index, bound)) {
+                delete bound;
+                return false;
+            }
+            auto sess = take(key);
+            if (!sess) {
+                return false;
+            }
+            auto res = ::SSL_set_session(ssl, sess);
+            ::SSL_SESSION_free(sess);
+            return res == 1;
+        }
+
+        //count result of handshake of ssl
+        void record(::SSL* ssl) {
+            if (::SSL_session_reused(ssl)) {
+                hits++;
+            }
+            else {
+                misses++;
+            }
+        }
+
+        size_t hit_count() const {
+            return hits;
+        }
+
+        size_t miss_count() const {
+            return misses;
+        }
+
+        void clear() {
+            std::lock_guard<std::mutex> guard(lock);
+            for (auto& s : sessions) {
+                for (auto sess : s.second) {
+                    ::SSL_SESSION_free(sess);
+                }
+            }
+            sessions.clear();
+        }
+
+        ~SSLSessionCache() {
+            clear();
+        }
+
+       private:
+        std::mutex lock;
+        std::map<std::string, std::deque<::SSL_SESSION*>> sessions;
+        std::atomic<size_t> hits{0};
+        std::atomic<size_t> misses{0};
+
+        SSLSessionCache() {}
+
+        static void free_key(void*, void* ptr, ::CRYPTO_EX_DATA*, int, long, void*) {
+            delete (std::string*)ptr;
+        }
+
+        static int key_index() {
+            static int index = ::SSL_get_ex_new_index(0, nullptr, nullptr, nullptr, free_key);
+            return index;
+        }
+
+        static int on_new_session(::SSL* ssl, ::SSL_SESSION* sess) {
+            auto key = (std::string*)::SSL_get_ex_data(ssl, key_index());
+            if (!key || !::SSL_SESSION_is_resumable(sess)) {
+                return 0;
+            }
+            instance().store(*key, sess);
+            //reference is owned by cache
+            return 1;
+        }
+
+        void store(const std::string& key, ::SSL_SESSION* sess) {
+            std::lock_guard<std::mutex> guard(lock);
+            auto& list = sessions[key];
+            list.push_back(sess);
+            while (list.size() > max_per_key) {
+                ::SSL_SESSION_free(list.front());
+                list.pop_front();
+            }
+        }
+
+        //returns session with reference which caller must free, or nullptr
+        //TLS 1.3 ticket is removed because it should be used only once (RFC 8446 C.4)
+        ::SSL_SESSION* take(const std::string& key) {
+            std::lock_guard<std::mutex> guard(lock);
+            auto found = sessions.find(key);
+            if (found == sessions.end()) {
+                return nullptr;
+            }
+            auto& list = found->second;
+            auto now = (long)std::time(nullptr);
+            ::SSL_SESSION* res = nullptr;
+            while (list.size()) {
+                auto sess = list.back();
+                if (::SSL_SESSION_get_time(sess) + ::SSL_SESSION_get_timeout(sess) < now) {
+                    ::SSL_SESSION_free(sess);
+                    list.pop_back();
+                    continue;
+                }
+                if (::SSL_SESSION_get_protocol_version(sess) >= TLS1_3_VERSION) {
+                    list.pop_back();
+                }
+                else {
+                    ::SSL_SESSION_up_ref(sess);
+                }
+                res = sess;
+                break;
+            }
+            if (list.empty()) {
+                sessions.erase(found);
+            }
+            return res;
+        }
+    };
+#endif
+}  // namespace socklib
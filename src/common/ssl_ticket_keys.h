@@ -0,0 +1,168 @@
+/*
+    socklib - simple socket library
+    Copyright (c) 2021 on-keyday (https://github.com/on-keyday)
+    Released under the MIT license
+    https://opensource.org/licenses/mit-license.php
+*/
+
+#pragma once
+
+#include "platform.h"
+
+#include <mutex>
+#include <deque>
+#include <ctime>
+#include <cstdint>
+
+#if USE_OPENSSL
+#include <openssl/rand.h>
+#include <openssl/evp.h>
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+#include <openssl/core_names.h>
+#else
+#include <openssl/hmac.h>
+#endif
+#endif
+
+namespace socklib {
+#if USE_OPENSSL
+    struct SSLTicketKey {
+        unsigned char name[16] = {0};
+        unsigned char aes[32] = {0};
+        unsigned char hmac[32] = {0};
+        std::time_t created = 0;
+    };
+
+    //SSLTicketKeys - keys of stateless session tickets of server SSL_CTX
+    //new key is made every rotation_sec, and tickets of previous keys are accepted (and renewed) for keep more rotations
+    //so that no session state is kept on server and a leaked key exposes only sessions of limited time
+    struct SSLTicketKeys {
+        std::uint32_t rotation_sec = 3600;
+        size_t keep = 2;
+
+        //make sslctx encrypt and decrypt tickets with keys
+        //keys must live while sslctx is alive
+        static void install(::SSL_CTX* sslctx, SSLTicketKeys* keys) {
+            ::SSL_CTX_set_ex_data(sslctx, index(), keys);
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+            ::SSL_CTX_set_tlsext_ticket_key_evp_cb(sslctx, ticket_key_cb);
+#else
+            ::SSL_CTX_set_tlsext_ticket_key_cb(sslctx, ticket_key_cb);
+#endif
+        }
+
+        //key to encrypt new ticket
+        bool current(SSLTicketKey& key) {
+            std::lock_guard<std::mutex> guard(lock);
+            auto now = std::time(nullptr);
+            if (keys.empty() || now - keys.front().created >= (std::time_t)rotation_sec) {
+                SSLTicketKey next;
+                if (::RAND_bytes(next.name, sizeof(next.name)) != 1 ||
+                    ::RAND_bytes(next.aes, sizeof(next.aes)) != 1 ||
+                    ::RAND_bytes(next.hmac, sizeof(next.hmac)) != 1) {
+                    return false;
+                }
+                next.created = now;
+                keys.push_front(next);
+                while (keys.size() > keep + 1) {
+                    keys.pop_back();
+                }
+            }
+            key = keys.front();
+            return true;
+        }
+
+        //key which encrypted ticket of name
+        //renew is set if it is not current key
+        bool find(const unsigned char* name, SSLTicketKey& key, bool& renew) {
+            std::lock_guard<std::mutex> guard(lock);
+            auto now = std::time(nullptr);
+            for (size_t i = 0; i < keys.size(); i++) {
+                if (::memcmp(keys[i].name, name, sizeof(keys[i].name)) != 0) {
+                    continue;
+                }
+                //expired key is dropped on next rotation, but must not be used after its lifetime
+                if (now - keys[i].created >= (std::time_t)rotation_sec * (std::time_t)(keep + 1)) {
+                    return false;
+                }
+                key = keys[i];
+                renew = i != 0 || now - keys[i].created >= (std::time_t)rotation_sec;
+                return true;
+            }
+            return false;
+        }
+
+       private:
+        std::mutex lock;
+        //current key is front
+        std::deque<SSLTicketKey> keys;
+
+        static int index() {
+            static int idx = ::SSL_CTX_get_ex_new_index(0, nullptr, nullptr, nullptr, nullptr);
+            return idx;
+        }
+
+        //returns 1 if key is set, 2 if ticket should be renewed, 0 if ticket is not decryptable and -1 if failed
+        static int select_key(::SSL* ssl, unsigned char* name, unsigned char* iv, ::EVP_CIPHER_CTX* cctx, int enc, SSLTicketKey& key) {
+            auto keys = (SSLTicketKeys*)::SSL_CTX_get_ex_data(::SSL_get_SSL_CTX(ssl), index());
+            if (!keys) {
+                return -1;
+            }
+            if (enc) {
+                if (!keys->current(key) || ::RAND_bytes(iv, EVP_MAX_IV_LENGTH) != 1) {
+                    return -1;
+                }
+                ::memcpy(name, key.name, sizeof(key.name));
+                if (!::EVP_EncryptInit_ex(cctx, ::EVP_aes_256_cbc(), nullptr, key.aes, iv)) {
+                    return -1;
+                }
+                return 1;
+            }
+            bool renew = false;
+            if (!keys->find(name, key, renew)) {
+                return 0;
+            }
+            if (!::EVP_DecryptInit_ex(cctx, ::EVP_aes_256_cbc(), nullptr, key.aes, iv)) {
+                return -1;
+            }
+            //TLS 1.3 client uses ticket only once, so it needs new ticket on each resumption
+            if (renew || ::SSL_version(ssl) >= TLS1_3_VERSION) {
+                return 2;
+            }
+            return 1;
+        }
+
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+        static int ticket_key_cb(::SSL* ssl, unsigned char* name, unsigned char* iv, ::EVP_CIPHER_CTX* cctx, ::EVP_MAC_CTX* hctx, int enc) {
+            SSLTicketKey key;
+            auto res = select_key(ssl, name, iv, cctx, enc, key);
+            if (res <= 0) {
+                return res;
+            }
+            char digest[] = "SHA256";
+            ::OSSL_PARAM params[] = {
+                ::OSSL_PARAM_construct_octet_string(OSSL_MAC_PARAM_KEY, key.hmac, sizeof(key.hmac)),
+                ::OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST, digest, 0),
+                ::OSSL_PARAM_construct_end(),
+            };
+            if (!::EVP_MAC_CTX_set_params(hctx, params)) {
+                return -1;
+            }
+            return res;
+        }
+#else
+        static int ticket_key_cb(::SSL* ssl, unsigned char* name, unsigned char* iv, ::EVP_CIPHER_CTX* cctx, ::HMAC_CTX* hctx, int enc) {
+            SSLTicketKey key;
+            auto res = select_key(ssl, name, iv, cctx, enc, key);
+            if (res <= 0) {
+                return res;
+            }
+            if (!::HMAC_Init_ex(hctx, key.hmac, sizeof(key.hmac), ::EVP_sha256(), nullptr)) {
+                return -1;
+            }
+            return res;
+        }
+#endif
+    };
+#endif
+}  // namespace socklib
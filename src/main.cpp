@@ -3,6 +3,7 @@
 
 #include "v1/application/http1.h"
 #include "v1/application/websocket.h"
+#include "v1/transport/epoll.h"
 
 #include <reader.h>
 #include <net_helper.h>
@@ -121,6 +122,26 @@ std::mutex mut;
 
 std::deque<std::shared_ptr<socklib::HttpServerConn>> que;
 
+socklib::EpollCtx poller;
+
+//wait next request on keep-alive connection without occupying thread
+//not used on windows (see server_proc)
+bool wait_keep_alive(std::shared_ptr<socklib::HttpServerConn>& conn, std::shared_ptr<socklib::Conn>& base) {
+    if (poller.rearm(base)) {
+        return true;
+    }
+    return poller.add(
+        base, [conn](std::shared_ptr<socklib::Conn>& base, socklib::EpollEvent ev) {
+            if ((ev & socklib::EpollEvent::read) == socklib::EpollEvent::none) {
+                poller.del(base);
+                base->close();
+                return;
+            }
+            std::lock_guard<std::mutex> guard(mut);
+            que.push_back(conn);
+        });
+}
+
 void print_log(std::shared_ptr<socklib::HttpServerConn>& conn, auto& method, unsigned short status,
                auto& print_time, const auto& id, const auto& subid, auto& recvtime) {
     auto end = std::chrono::system_clock::now();
@@ -302,11 +323,19 @@ void server_proc() {
                 if (!conn->recv()) {
                     got--;
                     std::cout << "thread-" << id << " recv failed\n";
+                    poller.del(conn->borrow());
+                    conn->close();
                     continue;
                 }
+                auto base = conn->borrow();
                 bool keep_alive = false, websocket = false;
                 parse_proc(conn, id, print_time, keep_alive, websocket);
-                if (keep_alive) {
+                if (websocket) {
+                    poller.del(base);
+                }
+                else if (keep_alive) {
+#ifdef _WIN32
+                    //EpollCtx has no backend on windows, so connection waits next request on its own thread
                     try {
                         std::thread(
                             [](std::shared_ptr<socklib::HttpServerConn> conn, std::thread::id id) {
@@ -338,6 +367,15 @@ void server_proc() {
                     } catch (...) {
                         std::cout << "start keep-alive thread failed\n";
                     }
+#else
+                    if (!wait_keep_alive(conn, base)) {
+                        std::cout << "thread-" << id << ":keep-alive end\n";
+                        conn->close();
+                    }
+#endif
+                }
+                else {
+                    poller.del(base);
                 }
 
             } catch (std::exception& e) {
@@ -361,6 +399,11 @@ void server_proc() {
     std::cout << "thread count:" << i << "\naccessable ipaddress\n";
     socklib::Server sv;
     std::cout << sv.ipaddress_list() << "\n";
+#ifndef _WIN32
+    std::thread([&] {
+        socklib::Epoller::loop(poller, proc_end, 1000, 5);
+    }).detach();
+#endif
     std::thread([&] {
         while (!proc_end) {
             std::string input;
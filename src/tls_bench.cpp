@@ -0,0 +1,172 @@
+/*
+    socklib - simple socket library
+    Copyright (c) 2021 on-keyday (https://github.com/on-keyday)
+    Released under the MIT license
+    https://opensource.org/licenses/mit-license.php
+*/
+
+//tls_bench - TLS handshake throughput of TCP::accept
+//usage: tls_bench <cert> <key> [seconds] [clients] [resume] [port]
+//server accepts on one thread and each client thread connects, reads one byte and closes repeatedly
+//handshakes per server cpu second is throughput per core
+
+#include "v2/tcp.h"
+
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <string>
+
+using namespace socklib;
+using namespace socklib::v2;
+
+static double thread_cpu_sec() {
+#ifdef _WIN32
+    FILETIME c, e, k, u;
+    ::GetThreadTimes(::GetCurrentThread(), &c, &e, &k, &u);
+    auto to_sec = [](FILETIME& t) {
+        return (double)(((std::uint64_t)t.dwHighDateTime << 32) | t.dwLowDateTime) / 1e7;
+    };
+    return to_sec(k) + to_sec(u);
+#else
+    ::timespec t;
+    ::clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t);
+    return (double)t.tv_sec + (double)t.tv_nsec / 1e9;
+#endif
+}
+
+//flag of InterruptContext shared between threads
+struct StopFlag {
+    std::atomic_bool value = false;
+    StopFlag(bool v = false)
+        : value(v) {}
+    StopFlag& operator=(const StopFlag& in) {
+        value = (bool)in.value;
+        return *this;
+    }
+    explicit operator bool() const {
+        return value;
+    }
+};
+
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        std::printf("usage: %s <cert> <key> [seconds] [clients] [resume] [port]\n", argv[0]);
+        return 2;
+    }
+    std::string cert = argv[1], key = argv[2];
+    int seconds = argc > 3 ? std::atoi(argv[3]) : 5;
+    int clients = argc > 4 ? std::atoi(argv[4]) : 4;
+    bool resume = argc > 5 ? std::atoi(argv[5]) != 0 : true;
+    std::uint16_t port = argc > 6 ? (std::uint16_t)std::atoi(argv[6]) : 8443;
+    if (!resume) {
+        SSLSessionCache::instance().max_per_key = 0;
+    }
+    //client may close before server writes
+    NetWorkInit::ignore_sigpipe();
+
+    TCPAcceptContext<std::string> actx;
+    actx.service = "https";
+    actx.port = port;
+    actx.servercert = cert;
+    actx.serverkey = key;
+    actx.stat.type = ConnType::tcp_over_ssl;
+    actx.stat.status = ConnStatus::secure;
+    if (!ServerHandler<std::string>::init_server(actx) || !ServerHandler<std::string>::init_ssl(actx)) {
+        std::printf("server init failed: %d\n", (int)actx.err);
+        return 1;
+    }
+
+    StopFlag stop;
+    std::atomic<size_t> accepted = 0, failed = 0;
+    double server_cpu = 0;
+    //closing waits for close_notify of client, so it is done by other thread to measure only accept
+    std::mutex lock;
+    std::condition_variable cv;
+    std::deque<std::shared_ptr<InetConn>> toclose;
+    std::thread server([&] {
+        InterruptContext<StopFlag> cancel(stop);
+        auto begin = thread_cpu_sec();
+        while (!stop.value) {
+            auto conn = TCP<std::string>::accept(actx, &cancel);
+            if (!conn) {
+                continue;
+            }
+            accepted++;
+            conn->write("x", 1);
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                toclose.push_back(std::move(conn));
+            }
+            cv.notify_one();
+        }
+        server_cpu = thread_cpu_sec() - begin;
+        cv.notify_one();
+    });
+    std::thread closer([&] {
+        while (true) {
+            std::unique_lock<std::mutex> guard(lock);
+            cv.wait(guard, [&] {
+                return toclose.size() || stop.value;
+            });
+            if (toclose.empty()) {
+                return;
+            }
+            auto conn = std::move(toclose.front());
+            toclose.pop_front();
+            guard.unlock();
+            TimeoutContext timeout(1);
+            conn->close(&timeout);
+        }
+    });
+
+    std::vector<std::thread> workers;
+    for (int i = 0; i < clients; i++) {
+        workers.emplace_back([&] {
+            InterruptContext<StopFlag> cancel(stop);
+            while (!stop.value) {
+                TCPOpenContext<std::string> octx;
+                octx.host = "localhost";
+                octx.service = "https";
+                octx.port = port;
+                octx.cacert = cert;
+                octx.stat.type = ConnType::tcp_over_ssl;
+                octx.stat.status = ConnStatus::secure;
+                std::shared_ptr<InetConn> conn;
+                if (!TCP<std::string>::open(conn, octx, &cancel)) {
+                    failed++;
+                    continue;
+                }
+                //TLS 1.3 tickets are received with first data
+                ReadContext<std::string> rd;
+                while (rd.buf.empty() && conn->read(rd, &cancel)) {
+                }
+                //server may be stopped before replying close_notify
+                TimeoutContext timeout(1);
+                conn->close(&timeout);
+            }
+        });
+    }
+
+    std::this_thread::sleep_for(std::chrono::seconds(seconds));
+    stop.value = true;
+    for (auto& w : workers) {
+        w.join();
+    }
+    server.join();
+    closer.join();
+
+    auto hits = SSLSessionCache::instance().hit_count();
+    auto misses = SSLSessionCache::instance().miss_count();
+    std::printf("handshakes: %zu (%zu failed) in %d sec\n", (size_t)accepted, (size_t)failed, seconds);
+    std::printf("handshakes/sec: %.1f\n", (double)accepted / seconds);
+    std::printf("server cpu: %.3f sec, handshakes/cpu sec: %.1f\n", server_cpu, server_cpu > 0 ? (double)accepted / server_cpu : 0.0);
+    std::printf("resumed: %zu/%zu\n", hits, hits + misses);
+    return 0;
+}
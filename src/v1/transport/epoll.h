@@ -10,36 +10,201 @@
 #include <learnstd.h>
 #include <memory>
 #include <map>
+#include <mutex>
+#include <functional>
 
 #ifdef _WIN32
 //#include <wepoll.h>
+#ifndef EPOLL_CTL_ADD
+#define EPOLL_CTL_ADD 1
+#define EPOLL_CTL_MOD 2
+#define EPOLL_CTL_DEL 3
+#endif
+#else
+#include <sys/epoll.h>
 #endif
 
 namespace socklib {
+    enum class EpollEvent : unsigned int {
+        none = 0,
+        read = 0x1,
+        write = 0x2,
+        hangup = 0x4,
+        error = 0x8,
+    };
+
+    DEFINE_ENUMOP(EpollEvent)
+
+    //EpollCtx holds registered connections and their callbacks
+    //connections are registered as edge-triggered and one-shot
+    //so callback must call rearm() if it wants to be notified again
     struct EpollCtx {
+        using callback_t = std::function<void(std::shared_ptr<Conn>&, EpollEvent)>;
+
        private:
         friend struct Epoller;
-        std::map<int, std::shared_ptr<Conn>> fds;
+        struct Entry {
+            std::shared_ptr<Conn> conn;
+            callback_t callback;
+            EpollEvent watch = EpollEvent::none;
+            std::time_t last = 0;
+        };
+        std::map<int, Entry> fds;
+        std::mutex lock;
+        int epfd = -1;
+
+        static unsigned int translate(EpollEvent ev) {
+            unsigned int ret = 0;
+#ifndef _WIN32
+            if ((ev & EpollEvent::read) != EpollEvent::none) ret |= EPOLLIN | EPOLLRDHUP;
+            if ((ev & EpollEvent::write) != EpollEvent::none) ret |= EPOLLOUT;
+            ret |= EPOLLET | EPOLLONESHOT;
+#endif
+            return ret;
+        }
+
+        static EpollEvent translate_back(unsigned int ev) {
+            EpollEvent ret = EpollEvent::none;
+#ifndef _WIN32
+            if (ev & EPOLLIN) ret |= EpollEvent::read;
+            if (ev & EPOLLOUT) ret |= EpollEvent::write;
+            if (ev & (EPOLLHUP | EPOLLRDHUP)) ret |= EpollEvent::hangup;
+            if (ev & EPOLLERR) ret |= EpollEvent::error;
+#endif
+            return ret;
+        }
+
+        bool ctl(int op, int fd, EpollEvent ev) {
+#ifdef _WIN32
+            return false;
+#else
+            ::epoll_event event = {0};
+            event.events = translate(ev);
+            event.data.fd = fd;
+            return ::epoll_ctl(epfd, op, fd, &event) == 0;
+#endif
+        }
 
        public:
-        bool add(std::shared_ptr<Conn>& fd) {
+        EpollCtx() {
+#ifndef _WIN32
+            epfd = ::epoll_create1(EPOLL_CLOEXEC);
+#endif
+        }
+
+        EpollCtx(const EpollCtx&) = delete;
+        EpollCtx& operator=(const EpollCtx&) = delete;
+
+        bool is_opened() const {
+            return epfd >= 0;
+        }
+
+        bool add(std::shared_ptr<Conn>& fd, callback_t callback = nullptr, EpollEvent ev = EpollEvent::read) {
+            if (!fd || fd->sock == invalid_socket) return false;
+            std::lock_guard<std::mutex> guard(lock);
             if (fds.find(fd->sock) != fds.end()) return false;
-            fds.emplace(fd->sock, fd);
+            if (!ctl(EPOLL_CTL_ADD, fd->sock, ev)) return false;
+            fds.emplace(fd->sock, Entry{fd, std::move(callback), ev, std::time(nullptr)});
+            return true;
+        }
+
+        //re-enable notification after callback was invoked
+        bool rearm(std::shared_ptr<Conn>& fd, EpollEvent ev = EpollEvent::read) {
+            if (!fd || fd->sock == invalid_socket) return false;
+            std::lock_guard<std::mutex> guard(lock);
+            auto found = fds.find(fd->sock);
+            if (found == fds.end()) return false;
+            if (!ctl(EPOLL_CTL_MOD, fd->sock, ev)) return false;
+            found->second.watch = ev;
+            found->second.last = std::time(nullptr);
             return true;
         }
 
         bool del(std::shared_ptr<Conn>& fd) {
+            if (!fd) return false;
+            std::lock_guard<std::mutex> guard(lock);
             if (fds.find(fd->sock) == fds.end()) return false;
+            ctl(EPOLL_CTL_DEL, fd->sock, EpollEvent::none);
             fds.erase(fd->sock);
-
             return true;
         }
+
+        size_t size() {
+            std::lock_guard<std::mutex> guard(lock);
+            return fds.size();
+        }
+
+        //close connections which is armed but not notified for idle seconds
+        size_t close_idle(std::time_t idle) {
+            std::map<int, Entry> expired;
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                auto now = std::time(nullptr);
+                for (auto it = fds.begin(); it != fds.end();) {
+                    if (it->second.watch != EpollEvent::none && now - it->second.last > idle) {
+                        ctl(EPOLL_CTL_DEL, it->first, EpollEvent::none);
+                        expired.emplace(it->first, std::move(it->second));
+                        it = fds.erase(it);
+                        continue;
+                    }
+                    it++;
+                }
+            }
+            for (auto& e : expired) {
+                e.second.conn->close();
+            }
+            return expired.size();
+        }
+
+        ~EpollCtx() {
+#ifndef _WIN32
+            if (epfd >= 0) {
+                ::close(epfd);
+            }
+#endif
+        }
     };
 
     struct Epoller {
-        static bool epoll(EpollCtx& ctx) {
+        //wait for events at most timeout milliseconds and invoke callbacks
+        //callbacks are invoked without lock, so callback can call add/rearm/del
+        static bool epoll(EpollCtx& ctx, int timeout = -1, size_t maxevent = 256) {
+#ifdef _WIN32
             //unimplemeted
             return false;
+#else
+            if (!ctx.is_opened()) return false;
+            if (maxevent == 0) maxevent = 1;
+            std::unique_ptr<::epoll_event[]> events(new ::epoll_event[maxevent]);
+            auto res = ::epoll_wait(ctx.epfd, events.get(), (int)maxevent, timeout);
+            if (res < 0) {
+                return errno == EINTR;
+            }
+            for (auto i = 0; i < res; i++) {
+                std::shared_ptr<Conn> conn;
+                EpollCtx::callback_t callback;
+                {
+                    std::lock_guard<std::mutex> guard(ctx.lock);
+                    auto found = ctx.fds.find(events[i].data.fd);
+                    if (found == ctx.fds.end()) continue;
+                    found->second.watch = EpollEvent::none;
+                    conn = found->second.conn;
+                    callback = found->second.callback;
+                }
+                if (callback) {
+                    callback(conn, EpollCtx::translate_back(events[i].events));
+                }
+            }
+            return true;
+#endif
+        }
+
+        static bool loop(EpollCtx& ctx, bool& suspend, int timeout = 1000, std::time_t idle = 0) {
+            while (!suspend) {
+                if (!epoll(ctx, timeout)) return false;
+                if (idle) ctx.close_idle(idle);
+            }
+            return true;
         }
     };
 }  // namespace socklib
@@ -11,6 +11,7 @@
 #include <memory>
 
 #include "sockbase.h"
+#include "../../common/io_wait.h"
 namespace socklib {
     struct Server {
        private:
@@ -170,7 +171,6 @@ namespace socklib {
             hint.ai_family = (ip == IPMode::v4only ? AF_INET : ip == IPMode::v6only ? AF_INET6
                                                                                     : AF_UNSPEC);
             TimeoutContext timer(60, cancel);
-            OsErrorContext ctx(&timer);
             if (getaddrinfo(host, service, &hint, &got) != 0) {
                 return OpenError::unresolved_address;
             }
@@ -198,39 +198,22 @@ namespace socklib {
                     ::ioctlsocket(tmp, FIONBIO, &flag);
                     break;
                 }
-                ::timeval timeout = {0};
-                ::fd_set baseset = {0}, sucset = {0}, errset = {0};
-                FD_ZERO(&baseset);
-                FD_SET(tmp, &baseset);
-                while (true) {
-                    memcpy(&sucset, &baseset, sizeof(::fd_set));
-                    memcpy(&errset, &baseset, sizeof(::fd_set));
-                    timeout.tv_sec = 0;
-                    timeout.tv_usec = 1;
-                    res = ::select(tmp + 1, nullptr, &sucset, &errset, &timeout);
-                    if (res < 0) {
-                        ::closesocket(tmp);
-                        break;
-                    }
-                    if (FD_ISSET(tmp, &errset)) {
-                        ::closesocket(tmp);
-                        break;
-                    }
-                    if (FD_ISSET(tmp, &sucset)) {
-                        sock = tmp;
-                        selected = p;
-                        flag = 0;
-                        ::ioctlsocket(tmp, FIONBIO, &flag);
-                        break;
-                    }
-                    if (ctx.on_cancel()) {
-                        ::closesocket(tmp);
-                        return OpenError::connect;
-                    }
+                if (!connect_in_progress()) {
+                    ::closesocket(tmp);
+                    continue;
                 }
-                if (sock != invalid_socket) {
+                auto waited = wait_connect(tmp, &timer);
+                if (waited == WaitResult::ready) {
+                    sock = tmp;
+                    selected = p;
+                    flag = 0;
+                    ::ioctlsocket(tmp, FIONBIO, &flag);
                     break;
                 }
+                ::closesocket(tmp);
+                if (waited == WaitResult::canceled) {
+                    return OpenError::connect;
+                }
             }
             return sock == invalid_socket ? OpenError::connect : OpenError::none;
         }
@@ -7,6 +7,10 @@
 
 #pragma once
 #include <array>
+#include <vector>
+#include <string_view>
+#include <unordered_map>
+#include <algorithm>
 #include "net_traits.h"
 #include <enumext.h>
 #include <serializer.h>
@@ -223,9 +227,9 @@ namespace socklib {
              {1, 1, 1, 0, 0, 0, 0},
              {1, 1, 1, 0, 0, 0, 1},
              {1, 1, 1, 0, 0, 1, 0},
-             {1, 1, 1, 1, 1, 1, 0},
+             {1, 1, 1, 1, 1, 1, 0, 0},
              {1, 1, 1, 0, 0, 1, 1},
-             {1, 1, 1, 1, 1, 1, 0},
+             {1, 1, 1, 1, 1, 1, 0, 1},
              {1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 1, 1},
              {1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0},
              {1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0},
@@ -303,7 +307,7 @@ namespace socklib {
              {1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 1, 0, 0, 0},
              {1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 1, 0, 0, 1},
              {1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 1, 1, 1, 1, 0},
-             {1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 1, 0, 1},
+             {1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 1, 0, 1, 0},
              {1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 1, 1, 1, 0, 1},
              {1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 1, 1, 1, 1, 0},
              {1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0},
@@ -393,170 +397,102 @@ namespace socklib {
              {1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 1, 1, 1, 0},
              {1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1}}};
 
-        template <class String>
-#ifdef COMMONLIB2_HAS_CONCEPTS
-        requires HpackString<String>
-#endif
-        struct bitvec_writer {
-            using string_t = String;
-
-           private:
-            string_t buf;
-            size_t idx = 0;
-            size_t pos = 0;
-
-           public:
-            bitvec_writer() {
-                buf.push_back(0);
-            }
-
-            void push_back(bool b) {
-                if (pos == 8) {
-                    buf.push_back(0);
-                    idx++;
-                    pos = 0;
-                }
-                unsigned char v = b ? 1 : 0;
-                buf[idx] |= (v << (7 - pos));
-                pos++;
-            }
-
-            template <class T>
-            void append(const T& a) {
-                for (auto i = 0; i < a.size(); i++) {
-                    push_back(a[i]);
-                }
-            }
-
-            size_t size() const {
-                return idx * 8 + pos;
-            }
-
-            string_t& data() {
-                return buf;
-            }
+        //code of h2huffman packed into least significant bits
+        struct h2huffman_code {
+            std::uint32_t code = 0;
+            std::uint8_t len = 0;
         };
 
-        template <class String>
-#ifdef COMMONLIB2_HAS_CONCEPTS
-        requires HpackString<String>
-#endif
-        struct bitvec_reader {
-           private:
-            size_t pos = 0;
-            size_t idx = 0;
-            String& str;
-
-           public:
-            bitvec_reader(String& in)
-                : str(in) {}
-
-            bool get() const {
-                if (idx == str.size()) return true;
-                return (bool)(((unsigned char)str[idx]) & (1 << (7 - pos)));
-            }
-
-            bool incremant() {
-                if (idx == str.size()) return false;
-                pos++;
-                if (pos == 8) {
-                    idx++;
-                    pos = 0;
+        constexpr std::array<h2huffman_code, 257> make_h2huffman_code_table() {
+            std::array<h2huffman_code, 257> table{};
+            for (size_t sym = 0; sym < 257; sym++) {
+                auto& v = h2huffman[sym];
+                for (size_t i = 0; i < v.size(); i++) {
+                    table[sym].code = (table[sym].code << 1) | (v[i] ? 1 : 0);
                 }
-                return true;
+                table[sym].len = static_cast<std::uint8_t>(v.size());
             }
+            return table;
+        }
 
-            bool decrement() {
-                if (pos == 0) {
-                    if (idx == 0) {
-                        return false;
-                    }
-                    idx--;
-                    pos = 8;
-                }
-                pos--;
-                return true;
-            }
+        constexpr std::array<h2huffman_code, 257> h2huffman_code_table = make_h2huffman_code_table();
 
-            bool eos() const {
-                return idx == str.size();
-            }
+        //entry of huffman decode state machine
+        //state is index of internal node of huffman tree (0 is root)
+        struct h2huffman_decode_entry {
+            std::uint8_t state = 0;
+            std::uint8_t flags = 0;
+            std::uint8_t sym = 0;
         };
 
-        struct h2huffman_tree {
-           private:
-            h2huffman_tree* zero = nullptr;
-            h2huffman_tree* one = nullptr;
-            unsigned char c = 0;
-            bool has_c = false;
-            bool eos = false;
-            constexpr h2huffman_tree() {}
-            ~h2huffman_tree() noexcept {
-                delete zero;
-                delete one;
-            }
-
-            static bool append(h2huffman_tree* tree, bool eos, unsigned char c, const bitvec_t& v, bitvec_t& res, size_t idx = 0) {
-                if (!tree) {
-                    return false;
-                }
-                if (v == res) {
-                    tree->c = c;
-                    tree->has_c = true;
-                    tree->eos = eos;
-                    if (tree->zero || tree->one) {
-                        throw "invalid hpack huffman";
+        //sym is decoded while reading nibble
+        constexpr std::uint8_t h2huffman_emit = 0x1;
+        //input can end at state (rest bits are valid padding)
+        constexpr std::uint8_t h2huffman_accept = 0x2;
+        //EOS is decoded
+        constexpr std::uint8_t h2huffman_fail = 0x4;
+
+        using h2huffman_decode_table_t = std::array<std::array<h2huffman_decode_entry, 16>, 256>;
+
+        constexpr h2huffman_decode_table_t make_h2huffman_decode_table() {
+            //child less than leaf is index of internal node, otherwise leaf of symbol (child - leaf)
+            //huffman tree of 257 symbols has 256 internal nodes
+            constexpr std::uint16_t leaf = 256;
+            std::array<std::array<std::uint16_t, 2>, 256> tree{};
+            std::uint16_t count = 1;
+            for (std::uint16_t sym = 0; sym < 257; sym++) {
+                auto& code = h2huffman[sym];
+                std::uint16_t n = 0;
+                for (size_t i = 0; i < code.size(); i++) {
+                    auto& next = tree[n][code[i] ? 1 : 0];
+                    if (i == code.size() - 1) {
+                        next = leaf + sym;
+                        break;
                     }
-                    return true;
-                }
-                res.push_back(v[idx]);
-                if (v[idx]) {
-                    if (!tree->one) {
-                        tree->one = new h2huffman_tree();
+                    if (next == 0) {
+                        next = count++;
                     }
-                    return append(tree->one, eos, c, v, res, idx + 1);
-                }
-                else {
-                    if (!tree->zero) {
-                        tree->zero = new h2huffman_tree();
-                    }
-                    return append(tree->zero, eos, c, v, res, idx + 1);
+                    n = next;
                 }
             }
-
-            static h2huffman_tree* init_tree() {
-                static h2huffman_tree _tree = {};
-                for (auto i = 0; i < 256; i++) {
-                    bitvec_t res;
-                    append(&_tree, false, i, h2huffman[i], res);
+            //padding must be most significant bits of EOS and shorter than 8 bits
+            std::array<bool, 256> accepts{};
+            std::uint16_t n = 0;
+            accepts[0] = true;
+            for (auto i = 0; i < 7; i++) {
+                n = tree[n][1];
+                accepts[n] = true;
+            }
+            h2huffman_decode_table_t table{};
+            for (std::uint16_t state = 0; state < 256; state++) {
+                for (std::uint8_t nibble = 0; nibble < 16; nibble++) {
+                    h2huffman_decode_entry e{};
+                    n = state;
+                    for (auto i = 3; i >= 0; i--) {
+                        n = tree[n][(nibble >> i) & 1];
+                        if (n >= leaf) {
+                            if (n == leaf + 256) {
+                                e.flags |= h2huffman_fail;
+                                n = 0;
+                                break;
+                            }
+                            //shortest code is 5 bits so at most one symbol is decoded per nibble
+                            e.flags |= h2huffman_emit;
+                            e.sym = static_cast<std::uint8_t>(n - leaf);
+                            n = 0;
+                        }
+                    }
+                    e.state = static_cast<std::uint8_t>(n);
+                    if (accepts[n]) {
+                        e.flags |= h2huffman_accept;
+                    }
+                    table[state][nibble] = e;
                 }
-                bitvec_t res;
-                append(&_tree, true, 0, h2huffman[256], res);
-                return &_tree;
             }
+            return table;
+        }
 
-           public:
-            static const h2huffman_tree* tree() {
-                static h2huffman_tree* ret = init_tree();
-                return ret;
-            }
-
-            const h2huffman_tree* get(bool flag) const {
-                return flag ? one : zero;
-            }
-
-            bool has_char() const {
-                return has_c;
-            }
-
-            unsigned char get_char() const {
-                return c;
-            }
-
-            bool is_eos() const {
-                return eos;
-            }
-        };
+        constexpr h2huffman_decode_table_t h2huffman_decode_table = make_h2huffman_decode_table();
 
         enum class HpackError {
             none,
@@ -573,72 +509,82 @@ namespace socklib {
         template <class String>
         struct Http2HuffmanCoder {
             using string_t = String;
-            using writer_t = bitvec_writer<String>;
-            using reader_t = bitvec_reader<String>;
 
             static size_t gethuffmanlen(const string_t& str) {
                 size_t ret = 0;
                 for (auto& c : str) {
-                    ret += h2huffman[(unsigned char)c].size();
+                    ret += h2huffman_code_table[(unsigned char)c].len;
                 }
                 return (ret + 7) / 8;
             }
 
-            static string_t encode(const string_t& in) {
-                writer_t vec;
+            //append encoded in to out
+            //len must be gethuffmanlen(in)
+            static void encode(string_t& out, const string_t& in, size_t len) {
+                size_t pos = out.size();
+                out.resize(pos + len);
+                //codes are at most 30 bits so acc never holds more than 61 bits
+                std::uint64_t acc = 0;
+                size_t bits = 0;
                 for (auto c : in) {
-                    vec.append(h2huffman[(unsigned char)c]);
+                    auto& code = h2huffman_code_table[(unsigned char)c];
+                    acc = (acc << code.len) | code.code;
+                    bits += code.len;
+                    if (bits >= 32) {
+                        bits -= 32;
+                        auto word = static_cast<std::uint32_t>(acc >> bits);
+                        out[pos] = static_cast<char>(word >> 24);
+                        out[pos + 1] = static_cast<char>(word >> 16);
+                        out[pos + 2] = static_cast<char>(word >> 8);
+                        out[pos + 3] = static_cast<char>(word);
+                        pos += 4;
+                    }
+                }
+                if (bits % 8) {
+                    //pad with most significant bits of EOS
+                    auto pad = 8 - bits % 8;
+                    acc = (acc << pad) | ((1 << pad) - 1);
+                    bits += pad;
                 }
-                //vec.append(h2huffman[256]);
-                while (vec.size() % 8) {
-                    vec.push_back(true);
+                while (bits) {
+                    bits -= 8;
+                    out[pos] = static_cast<char>(acc >> bits);
+                    pos++;
                 }
-                return vec.data();
             }
 
-           private:
-            static HpkErr decode_achar(unsigned char& c, reader_t& r, const h2huffman_tree* t, const h2huffman_tree*& fin, std::uint32_t& allone) {
-                for (;;) {
-                    if (!t) {
-                        return HpackError::invalid_value;
-                    }
-                    if (t->has_char()) {
-                        c = t->get_char();
-                        fin = t;
-                        return true;
-                    }
-                    bool f = r.get();
-                    if (!r.incremant()) {
-                        return HpackError::too_short_number;
-                    }
-                    const h2huffman_tree* next = t->get(f);
-                    allone = (allone && f) ? allone + 1 : 0;
-                    t = next;
-                }
+            static string_t encode(const string_t& in) {
+                string_t ret;
+                encode(ret, in, gethuffmanlen(in));
+                return ret;
             }
 
-           public:
             static HpkErr decode(string_t& res, string_t& src) {
-                reader_t r(src);
-                auto tree = h2huffman_tree::tree();
-                while (!r.eos()) {
-                    unsigned char c = 0;
-                    const h2huffman_tree* fin = nullptr;
-                    std::uint32_t allone = 1;
-                    auto tmp = decode_achar(c, r, tree, fin, allone);
-                    if (!tmp) {
-                        if (tmp == HpackError::too_short_number) {
-                            if (!r.eos() && allone - 1 > 7) {
-                                return HpackError::too_large_number;
-                            }
-                            break;
-                        }
-                        return tmp;
+                std::uint8_t state = 0;
+                std::uint8_t flags = h2huffman_accept;
+                //shortest code is 5 bits
+                res.reserve(res.size() + src.size() * 8 / 5);
+                for (auto c : src) {
+                    auto byte = (unsigned char)c;
+                    auto& high = h2huffman_decode_table[state][byte >> 4];
+                    if (high.flags & h2huffman_fail) {
+                        return HpackError::invalid_value;
                     }
-                    if (fin->is_eos()) {
+                    if (high.flags & h2huffman_emit) {
+                        res.push_back(high.sym);
+                    }
+                    auto& low = h2huffman_decode_table[high.state][byte & 0xf];
+                    if (low.flags & h2huffman_fail) {
                         return HpackError::invalid_value;
                     }
-                    res.push_back(c);
+                    if (low.flags & h2huffman_emit) {
+                        res.push_back(low.sym);
+                    }
+                    state = low.state;
+                    flags = low.flags;
+                }
+                if (!(flags & h2huffman_accept)) {
+                    return HpackError::too_large_number;
                 }
                 return true;
             }
@@ -708,10 +654,11 @@ namespace socklib {
             using string_t = String;
 
             static void encode(commonlib2::Serializer<string_t&>& se, const string_t& value) {
-                if (value.size() > huffman_coder::gethuffmanlen(value)) {
-                    string_t enc = huffman_coder::encode(value);
-                    integer_coder::template encode<7>(se, enc.size(), 0x80);
-                    se.write_byte(enc);
+                //use huffman only when it is shorter
+                auto len = huffman_coder::gethuffmanlen(value);
+                if (len < value.size()) {
+                    integer_coder::template encode<7>(se, len, 0x80);
+                    huffman_coder::encode(se.get(), value, len);
                 }
                 else {
                     integer_coder::template encode<7>(se, value.size(), 0);
@@ -733,6 +680,178 @@ namespace socklib {
             }
         };
 
+        //size of entry defined in RFC7541 4.1
+        constexpr size_t hpack_entry_overhead = 32;
+
+        template <class T>
+        std::string_view hpack_view(const T& str) {
+            return std::string_view(str.data(), str.size());
+        }
+
+        using hpack_field_view = std::pair<std::string_view, std::string_view>;
+
+        struct hpack_field_hash {
+            size_t operator()(const hpack_field_view& f) const {
+                auto h = std::hash<std::string_view>{}(f.first);
+                return h ^ (std::hash<std::string_view>{}(f.second) + 0x9e3779b9 + (h << 6) + (h >> 2));
+            }
+        };
+
+        //hashed index of predefined_header
+        struct HpackStaticIndex {
+           private:
+            std::unordered_map<std::string_view, size_t> names;
+            std::unordered_map<hpack_field_view, size_t, hpack_field_hash> fields;
+
+            HpackStaticIndex() {
+                for (size_t i = predefined_header_size - 1; i > 0; i--) {
+                    names[predefined_header[i].first] = i;
+                    //entries without value are only used by name
+                    if (predefined_header[i].second[0]) {
+                        fields[{predefined_header[i].first, predefined_header[i].second}] = i;
+                    }
+                }
+            }
+
+           public:
+            static const HpackStaticIndex& get() {
+                static HpackStaticIndex index;
+                return index;
+            }
+
+            bool find_field(std::string_view name, std::string_view value, size_t& idx) const {
+                auto found = fields.find({name, value});
+                if (found == fields.end()) return false;
+                idx = found->second;
+                return true;
+            }
+
+            bool find_name(std::string_view name, size_t& idx) const {
+                auto found = names.find(name);
+                if (found == names.end()) return false;
+                idx = found->second;
+                return true;
+            }
+        };
+
+        //HPACK dynamic table on ring buffer
+        //index 0 is the newest entry
+        //size is tracked as RFC7541 4.1 on insertion and eviction
+        //names and fields are hashed so that encoder can find entry without scanning
+        template <class String>
+        struct HpackDynamicTable {
+            using string_t = String;
+            using entry_t = std::pair<string_t, string_t>;
+
+           private:
+            std::vector<entry_t> ring;
+            size_t oldest = 0;
+            size_t count = 0;
+            size_t tablesize = 0;
+            //sequence number of next inserted entry
+            std::uint64_t inserted = 0;
+            //keys refer to strings in ring, values are sequence number of the newest entry
+            std::unordered_map<std::string_view, std::uint64_t> names;
+            std::unordered_map<hpack_field_view, std::uint64_t, hpack_field_hash> fields;
+
+            size_t slot(size_t i) const {
+                return (oldest + count - 1 - i) & (ring.size() - 1);
+            }
+
+            void index(const entry_t& e, std::uint64_t seq) {
+                auto name = hpack_view(e.first);
+                auto field = hpack_field_view{name, hpack_view(e.second)};
+                //replace keys too because old keys refer to older entry
+                names.erase(name);
+                names.emplace(name, seq);
+                fields.erase(field);
+                fields.emplace(field, seq);
+            }
+
+            void grow() {
+                std::vector<entry_t> next(ring.size() ? ring.size() * 2 : 16);
+                for (size_t i = 0; i < count; i++) {
+                    next[count - 1 - i] = std::move(ring[slot(i)]);
+                }
+                ring = std::move(next);
+                oldest = 0;
+                names.clear();
+                fields.clear();
+                for (size_t i = 0; i < count; i++) {
+                    index(ring[i], inserted - count + i);
+                }
+            }
+
+            bool to_idx(std::uint64_t seq, size_t& idx) const {
+                if (seq + count < inserted) return false;
+                idx = (size_t)(inserted - 1 - seq);
+                return true;
+            }
+
+           public:
+            void push_front(string_t name, string_t value) {
+                if (count == ring.size()) {
+                    grow();
+                }
+                auto& e = ring[(oldest + count) & (ring.size() - 1)];
+                e.first = std::move(name);
+                e.second = std::move(value);
+                count++;
+                tablesize += e.first.size() + e.second.size() + hpack_entry_overhead;
+                index(e, inserted);
+                inserted++;
+            }
+
+            void pop_back() {
+                if (!count) return;
+                auto& e = ring[oldest];
+                auto seq = inserted - count;
+                auto name = names.find(hpack_view(e.first));
+                if (name != names.end() && name->second == seq) {
+                    names.erase(name);
+                }
+                auto field = fields.find({hpack_view(e.first), hpack_view(e.second)});
+                if (field != fields.end() && field->second == seq) {
+                    fields.erase(field);
+                }
+                tablesize -= e.first.size() + e.second.size() + hpack_entry_overhead;
+                e = entry_t{};
+                oldest = (oldest + 1) & (ring.size() - 1);
+                count--;
+            }
+
+            //evict entries until table size is not over maxsize
+            void evict(size_t maxsize) {
+                while (tablesize > maxsize) {
+                    pop_back();
+                }
+            }
+
+            bool find_field(std::string_view name, std::string_view value, size_t& idx) const {
+                auto found = fields.find({name, value});
+                if (found == fields.end()) return false;
+                return to_idx(found->second, idx);
+            }
+
+            bool find_name(std::string_view name, size_t& idx) const {
+                auto found = names.find(name);
+                if (found == names.end()) return false;
+                return to_idx(found->second, idx);
+            }
+
+            size_t table_size() const {
+                return tablesize;
+            }
+
+            size_t size() const {
+                return count;
+            }
+
+            const entry_t& operator[](size_t i) const {
+                return ring[slot(i)];
+            }
+        };
+
         template <class String, class Table, class Header>
 #ifdef COMMONLIB2_HAS_CONCEPTS
         requires HpackDynamycTable<Table, String>
@@ -745,33 +864,28 @@ namespace socklib {
             using header_t = Header;
 
            private:
-            template <class F>
-            static bool get_idx(F&& f, size_t& idx, table_t& dymap) {
-                if (auto found = std::find_if(predefined_header.begin() + 1, predefined_header.end(), [&](auto& c) {
-                        return f(c.first, c.second);
-                    });
-                    found != predefined_header.end()) {
-                    idx = std::distance(predefined_header.begin(), found);
-                }
-                else if (auto found = std::find_if(dymap.begin(), dymap.end(), [&](auto& c) {
-                             return f(c.first, c.second);
-                         });
-                         found != dymap.end()) {
-                    idx = std::distance(dymap.begin(), found) + predefined_header_size;
+            static bool get_field_idx(const string_t& name, const string_t& value, size_t& idx, table_t& dymap) {
+                auto n = hpack_view(name), v = hpack_view(value);
+                if (HpackStaticIndex::get().find_field(n, v, idx)) {
+                    return true;
                 }
-                else {
-                    return false;
+                if (dymap.find_field(n, v, idx)) {
+                    idx += predefined_header_size;
+                    return true;
                 }
-                return true;
+                return false;
             }
 
-            static size_t calc_table_size(table_t& table) {
-                size_t size = 32;
-                for (auto& e : table) {
-                    size += e.first.size();
-                    size += e.second.size();
+            static bool get_name_idx(const string_t& name, size_t& idx, table_t& dymap) {
+                auto n = hpack_view(name);
+                if (HpackStaticIndex::get().find_name(n, idx)) {
+                    return true;
+                }
+                if (dymap.find_name(n, idx)) {
+                    idx += predefined_header_size;
+                    return true;
                 }
-                return size;
+                return false;
             }
 
            public:
@@ -781,19 +895,11 @@ namespace socklib {
                 commonlib2::Serializer<string_t&> se(dst);
                 for (auto& h : src) {
                     size_t idx = 0;
-                    if (get_idx(
-                            [&](const auto& k, const auto& v) {
-                                return k == h.first && v == h.second;
-                            },
-                            idx, dymap)) {
+                    if (get_field_idx(h.first, h.second, idx, dymap)) {
                         TRY(integer_coder::template encode<7>(se, idx, 0x80));
                     }
                     else {
-                        if (get_idx(
-                                [&](const auto& k, const auto&) {
-                                    return k == h.first;
-                                },
-                                idx, dymap)) {
+                        if (get_name_idx(h.first, idx, dymap)) {
                             if (adddy) {
                                 TRY(integer_coder::template encode<6>(se, idx, 0x40));
                             }
@@ -802,19 +908,13 @@ namespace socklib {
                             }
                         }
                         else {
-                            se.template write_as<std::uint8_t>(0);
+                            se.template write_as<std::uint8_t>(adddy ? 0x40 : 0);
                             string_coder::encode(se, h.first);
                         }
                         string_coder::encode(se, h.second);
                         if (adddy) {
-                            dymap.push_front({h.first, h.second});
-                            size_t tablesize = calc_table_size(dymap);
-                            while (tablesize > maxtablesize) {
-                                if (!dymap.size()) return false;
-                                tablesize -= dymap.back().first.size();
-                                tablesize -= dymap.back().second.size();
-                                dymap.pop_back();
-                            }
+                            dymap.push_front(h.first, h.second);
+                            dymap.evict(maxtablesize);
                         }
                     }
                 }
@@ -824,16 +924,7 @@ namespace socklib {
             static HpkErr decode(header_t& res, string_t& src,
                                  table_t& dymap, std::uint32_t& maxtablesize) {
                 auto update_dymap = [&] {
-                    size_t tablesize = calc_table_size(dymap);
-                    while (tablesize > maxtablesize) {
-                        if (tablesize == 32) break;  //TODO: check what written in RFC means
-                        if (!dymap.size()) {
-                            return false;
-                        }
-                        tablesize -= dymap.back().first.size();
-                        tablesize -= dymap.back().second.size();
-                        dymap.pop_back();
-                    }
+                    dymap.evict(maxtablesize);
                     return true;
                 };
                 commonlib2::Deserializer<string_t&> se(src);
@@ -890,7 +981,7 @@ namespace socklib {
                         else {
                             TRY(read_idx_and_literal(sz));
                         }
-                        dymap.push_front({key, value});
+                        dymap.push_front(std::move(key), std::move(value));
                         TRY(update_dymap());
                     }
                     else if (tmp & 0x20) {  //dynamic table size change
@@ -9,6 +9,7 @@
 
 #include "http1.h"
 #include "http2.h"
+#include "http_pool.h"
 
 #include <deque>
 
@@ -122,6 +123,14 @@ namespace socklib {
             const commonlib2::URLContext<String>& get_parsed() const {
                 return ctx.parsed;
             }
+
+            //received body (response body on client, request body on server) is passed to sink as it arrives
+            //instead of being stored in responseBody() or requestBody() (see RequestContext::body_sink)
+            //sink is called with sinkctx, and nullptr disables it
+            void set_body_sink(typename RequestContext<String, Header, Body>::body_sink_t sink, void* sinkctx = nullptr) {
+                ctx.body_sink = sink;
+                ctx.sinkctx = sinkctx;
+            }
         };
 
         template <class String, class Header, class Body, template <class...> class Map, class Table>
@@ -129,12 +138,31 @@ namespace socklib {
             using base_t = RequestProxy<String, Header, Body, Map, Table>;
             using http1client_t = Http1Client<String, Header, Body>;
             using http2client_t = Http2Client<String, Map, Header, Body, Table>;
+            using h2client_t = Http2ClientContext<String, Map, Header, Body, Table>;
+            using request_t = RequestContext<String, Header, Body>;
             using opener_t = HttpBase<String, Header, Body>;
+            using pool_t = HttpConnPool<String, Header, Body, Map, Table>;
+            using pooled_t = typename pool_t::conn_t;
 
            private:
+            h2client_t h2cli;
+            //responses of send_request() on HTTP/1.1 connection
+            std::deque<request_t> h1done;
+            std::shared_ptr<pool_t> pool;
+            //origin which connection is leased for
+            String poolkey;
+            bool leased = false;
+
            public:
             ClientRequestProxy() {}
 
+            ClientRequestProxy(std::shared_ptr<pool_t> p)
+                : pool(std::move(p)) {}
+
+            ~ClientRequestProxy() {
+                release();
+            }
+
             Header& requestHeader() {
                 return this->ctx.request;
             }
@@ -172,10 +200,80 @@ namespace socklib {
             }
 
            private:
-            bool h2request(CancelContext* cancel = nullptr) {
+            //whether connection can be used by next request without reopening
+            bool reusable() const {
+                if (!this->enable_conn()) {
+                    return false;
+                }
+                auto phase = this->ctx.phase;
+                if (phase != RequestPhase::body_recved && phase != RequestPhase::open_direct && phase != RequestPhase::idle) {
+                    return false;
+                }
+                if (this->ctx.resolved_version == 2) {
+                    return this->h2buf && !h2cli.exchanges.size() && !h2cli.goaway_recved && this->h2ctx.err == H2Error::none;
+                }
+                if (this->ctx.resolved_version != 1) {
+                    return false;
+                }
+                return !this->h1buf || (h1keep_alive() && !this->h1buf->rawdata.size());
+            }
+
+            //whether server keeps HTTP/1 connection open after last response
+            //body without length is read until server closes connection
+            bool h1keep_alive() const {
+                return !this->h1buf->bodyinfo.close_conn && !this->h1buf->nolen;
+            }
+
+            void adopt(pooled_t& pooled) {
+                this->conn = std::move(pooled.conn);
+                this->ctx.resolved_version = pooled.version;
+                if (pooled.h2) {
+                    this->make_h2buf();
+                    this->h2ctx = std::move(pooled.h2->h2ctx);
+                    h2cli = std::move(pooled.h2->h2cli);
+                    this->h2buf->set_data(std::move(pooled.h2->rawdata));
+                }
+            }
+
+            bool open(CancelContext* cancel) {
+                if (!pool) {
+                    return opener_t::open(this->conn, this->ctx, cancel);
+                }
+                String key;
+                if (!opener_t::origin_key(this->ctx, key)) {
+                    return false;
+                }
+                if (leased && key == poolkey) {
+                    if (this->enable_conn()) {
+                        this->ctx.tcperr = TCPError::not_reopened;
+                        this->ctx.phase = RequestPhase::open_direct;
+                        return true;
+                    }
+                }
+                else {
+                    release();
+                    pooled_t pooled;
+                    if (!pool->lease(key, pooled, cancel)) {
+                        this->ctx.err = HttpError::tcp_error;
+                        this->ctx.tcperr = TCPError::canceled;
+                        return false;
+                    }
+                    leased = true;
+                    poolkey = std::move(key);
+                    if (pooled.conn) {
+                        adopt(pooled);
+                        this->ctx.tcperr = TCPError::not_reopened;
+                        this->ctx.phase = RequestPhase::open_direct;
+                        return true;
+                    }
+                }
+                return opener_t::open(this->conn, this->ctx, cancel);
+            }
+
+            bool h2open(CancelContext* cancel) {
                 this->make_h2buf();
                 if (this->ctx.tcperr != TCPError::not_reopened) {
-                    http2client_t::init(this->h2ctx);
+                    http2client_t::init(this->h2ctx, h2cli);
                     if (!http2client_t::send_connection_preface(this->conn, this->ctx, cancel)) {
                         return false;
                     }
@@ -183,9 +281,25 @@ namespace socklib {
                         return false;
                     }
                 }
+                return true;
+            }
+
+            bool h2request(CancelContext* cancel = nullptr) {
+                if (!h2open(cancel)) {
+                    return false;
+                }
                 return http2client_t::request(this->conn, *this->h2buf, cancel);
             }
 
+            //copy of ctx which owns request body
+            request_t make_exchange() {
+                auto body = std::move(this->ctx.requestbody);
+                this->ctx.requestbody.clear();
+                request_t req = this->ctx;
+                req.requestbody = std::move(body);
+                return req;
+            }
+
             void reset_ctx() {
                 this->ctx.responsebody.clear();
                 this->ctx.response.clear();
@@ -199,7 +313,7 @@ namespace socklib {
                 if (this->ctx.phase == RequestPhase::body_recved) {
                     this->ctx.phase = RequestPhase::idle;
                 }
-                if (!opener_t::open(this->conn, this->ctx, cancel)) {
+                if (!open(cancel)) {
                     return false;
                 }
                 if (this->ctx.resolved_version == 2) {
@@ -226,19 +340,153 @@ namespace socklib {
                 else {
                     auto e = http1client_t::response(this->conn, *this->h1buf, cancel);
                     if (e) {
-                        if (this->ctx.header_version < 11 || this->h1buf->bodyinfo.close_conn) {
+                        if (!h1keep_alive()) {
                             this->conn->close(cancel);
                         }
                     }
+                    else if (this->ctx.phase == RequestPhase::error) {
+                        //rest of message is left unread on connection
+                        this->conn->close(cancel);
+                    }
                     return e;
                 }
             }
+
+            //send request without waiting for its response
+            //on HTTP/2 connection, requests are multiplexed as streams on one connection
+            //and responses are received with wait_response() in the order they are completed
+            //on HTTP/1.1 connection, response is received before return
+            //url must have same origin while responses are pending
+            //request() and response() should not be used while responses are pending
+            bool send_request(const String& method, const String& url, CancelContext* cancel = nullptr) {
+                this->ctx.url = url;
+                this->ctx.method = method;
+                reset_ctx();
+                this->ctx.phase = RequestPhase::idle;
+                if (!open(cancel)) {
+                    return false;
+                }
+                if (this->ctx.resolved_version != 2) {
+                    this->make_h1buf();
+                    if (!http1client_t::request(this->conn, this->ctx, cancel) || !response(cancel)) {
+                        return false;
+                    }
+                    h1done.push_back(make_exchange());
+                    return true;
+                }
+                if (!h2open(cancel)) {
+                    return false;
+                }
+                auto req = make_exchange();
+                if (!http2client_t::start_request(this->conn, *this->h2buf, h2cli, req, cancel)) {
+                    return false;
+                }
+                this->ctx.streamid = req.streamid;
+                return true;
+            }
+
+            //wait until any response of send_request() is completed
+            //then response is accessible through responseHeader(), responseBody(), get_statuscode() and get_streamid()
+            //returns false if there is no pending request or request is failed
+            bool wait_response(CancelContext* cancel = nullptr) {
+                if (h1done.size()) {
+                    this->ctx = std::move(h1done.front());
+                    h1done.pop_front();
+                    return true;
+                }
+                if (!h2cli.exchanges.size()) {
+                    return false;
+                }
+                http2client_t::wait_response(this->conn, *this->h2buf, h2cli, cancel);
+                if (!http2client_t::take_response(h2cli, this->ctx)) {
+                    return false;
+                }
+                return this->ctx.phase == RequestPhase::body_recved;
+            }
+
+            //count of responses which are not received by wait_response() yet
+            size_t pending() const {
+                return h2cli.exchanges.size() + h1done.size();
+            }
+
+            //return connection to pool given to make_request(pool)
+            //connection is closed instead if it has unfinished exchange
+            //called on destruction
+            void release() {
+                if (!leased) {
+                    return;
+                }
+                leased = false;
+                pooled_t pooled;
+                if (reusable()) {
+                    pooled.conn = std::move(this->conn);
+                    pooled.version = this->ctx.resolved_version;
+                    if (pooled.version == 2) {
+                        pooled.h2 = std::make_unique<typename pool_t::session_t>();
+                        pooled.h2->h2ctx = std::move(this->h2ctx);
+                        pooled.h2->h2cli = std::move(h2cli);
+                        pooled.h2->rawdata.assign(this->h2buf->readptr(), this->h2buf->readable());
+                    }
+                }
+                else if (this->conn) {
+                    this->conn->close();
+                }
+                this->conn = nullptr;
+                if (this->h2buf) {
+                    this->h2buf->consume(this->h2buf->readable());
+                }
+                if (this->h1buf) {
+                    this->h1buf->rawdata.clear();
+                    this->h1buf->reset();
+                }
+                pool->release(poolkey, std::move(pooled));
+            }
         };
 
         template <class String, class Header, class Body, template <class...> class Map, class Table>
         struct ServerRequestProxy : RequestProxy<String, Header, Body, Map, Table> {
             using http1server_t = Http1Server<String, Header, Body>;
+            using http2server_t = Http2Server<String, Map, Header, Body, Table>;
+            using h2server_t = Http2ServerContext<String, Map, Header, Body, Table>;
+
+           private:
+            h2server_t h2srv;
+            int version = 0;
+
+            //decide version by ALPN if connection is secure
+            //otherwise version is decided by whether connection preface is received
+            void select_version() {
+                ConnStat stat;
+                this->conn->stat(stat);
+                if (!any(stat.status & ConnStatus::secure) || !stat.net.ssl) {
+                    return;
+                }
+                const unsigned char* proto = nullptr;
+                unsigned int len = 0;
+                ::SSL_get0_alpn_selected(stat.net.ssl, &proto, &len);
+                if (proto && len == 2 && ::memcmp(proto, "h2", 2) == 0) {
+                    version = 2;
+                }
+                else {
+                    version = 1;
+                }
+            }
+
+            bool start_h2(CancelContext* cancel) {
+                version = 2;
+                this->make_h2buf();
+                http2server_t::init(this->h2ctx, h2srv);
+                return http2server_t::send_first_settings(this->conn, this->ctx, this->h2ctx, h2srv, cancel);
+            }
 
+            bool h2request(CancelContext* cancel) {
+                if (!http2server_t::request(this->conn, *this->h2buf, h2srv, cancel)) {
+                    return false;
+                }
+                return http2server_t::take_request(h2srv, this->ctx);
+            }
+
+           public:
             ServerRequestProxy(std::shared_ptr<InetConn>&& con) {
                 this->conn = std::move(con);
             }
@@ -263,20 +511,100 @@ namespace socklib {
                 return this->ctx.method;
             }
 
+            bool is_http2() const {
+                return version == 2;
+            }
+
+            //on HTTP/2 connection, requests of multiplexed streams are returned one by one
+            //response() should be called before next request()
             bool request(CancelContext* cancel = nullptr) {
+                if (!this->conn) {
+                    return false;
+                }
+                if (version == 0) {
+                    select_version();
+                    if (version == 2 && !start_h2(cancel)) {
+                        return false;
+                    }
+                }
+                if (version == 2) {
+                    return h2request(cancel);
+                }
                 if (this->ctx.phase == RequestPhase::body_recved) {
                     this->ctx.phase = RequestPhase::idle;
                 }
                 this->ctx.request.clear();
                 this->ctx.requestbody.clear();
                 this->make_h1buf();
-                return http1server_t::request(this->conn, *this->h1buf, cancel);
+                if (version == 0) {
+                    this->h1buf->preface = h2_connection_preface;
+                }
+                auto res = http1server_t::request(this->conn, *this->h1buf, cancel);
+                if (this->h1buf->preface_matched) {
+                    //HTTP/2 with prior knowledge
+                    auto rest = std::move(this->h1buf->rawdata);
+                    this->ctx.phase = RequestPhase::idle;
+                    if (!start_h2(cancel)) {
+                        return false;
+                    }
+                    this->h2buf->set_data(rest.substr(24));
+                    h2srv.preface_recved = true;
+                    return h2request(cancel);
+                }
+                version = 1;
+                this->h1buf->preface = nullptr;
+                return res;
             }
 
             bool response(std::uint16_t status, CancelContext* cancel = nullptr) {
                 this->ctx.statuscode = status;
+                if (version == 2) {
+                    auto e = http2server_t::response(this->conn, *this->h2buf, this->ctx, cancel);
+                    if (e == H2Error::need_window_update) {
+                        //rest of body is sent when peer opens window
+                        http2server_t::defer(h2srv, this->ctx);
+                        return true;
+                    }
+                    return e;
+                }
                 return http1server_t::response(this->conn, this->ctx, cancel);
             }
+
+            //response with size bytes of file fd from offset as body
+            //on HTTP/1, file is sent by InetConn::send_file (see TCPAcceptContext::ktls for HTTPS)
+            //on HTTP/2, file is read into responseBody() because it is sent in DATA frames
+            bool response_file(std::uint16_t status, int fd, std::uint64_t offset, size_t size, CancelContext* cancel = nullptr) {
+                if (version == 2) {
+                    auto& body = this->ctx.responsebody;
+                    body.resize(size);
+                    size_t red = 0;
+                    while (red < size) {
+                        auto res = read_file_at(fd, &body[red], size - red, offset + red);
+                        if (res <= 0) {
+                            return false;
+                        }
+                        red += (size_t)res;
+                    }
+                    return response(status, cancel);
+                }
+                this->ctx.statuscode = status;
+                return http1server_t::response_file(this->conn, this->ctx, fd, offset, size, cancel);
+            }
+
+            //send deferred HTTP/2 response data
+            bool flush(CancelContext* cancel = nullptr) {
+                if (version != 2) {
+                    return true;
+                }
+                return http2server_t::flush(this->conn, *this->h2buf, h2srv, cancel);
+            }
+
+            virtual void close(CancelContext* cancel) override {
+                if (this->conn && version == 2) {
+                    http2server_t::shutdown(this->conn, *this->h2buf, cancel);
+                }
+                RequestProxy<String, Header, Body, Map, Table>::close(cancel);
+            }
         };
 
         template <class String, class Header, class Body, template <class...> class Map, class Table>
@@ -284,6 +612,12 @@ namespace socklib {
             return std::make_shared<ClientRequestProxy<String, Header, Body, Map, Table>>();
         }
 
+        //requests of returned proxy use keep-alive connections in pool
+        template <class String, class Header, class Body, template <class...> class Map, class Table>
+        std::shared_ptr<ClientRequestProxy<String, Header, Body, Map, Table>> make_request(std::shared_ptr<HttpConnPool<String, Header, Body, Map, Table>> pool) {
+            return std::make_shared<ClientRequestProxy<String, Header, Body, Map, Table>>(std::move(pool));
+        }
+
         template <class String, class Header, class Body, template <class...> class Map, class Table>
         std::shared_ptr<ServerRequestProxy<String, Header, Body, Map, Table>> accept_request(std::shared_ptr<InetConn>&& conn) {
             return std::make_shared<ServerRequestProxy<String, Header, Body, Map, Table>>(std::move(conn));
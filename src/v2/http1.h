@@ -7,6 +7,20 @@
 
 #pragma once
 #include "http_base.h"
+#include <string_view>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SOCKLIB_HAS_SSE2
+#include <emmintrin.h>
+#endif
+#ifdef __AVX2__
+#define SOCKLIB_HAS_AVX2
+#include <immintrin.h>
+#endif
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
 
 namespace socklib {
     namespace v2 {
@@ -26,7 +40,16 @@ namespace socklib {
                 return errorhandle_t::write_to_conn(conn, w, req, cancel);
             }
 
-            static bool write_header_common(string_t& towrite, Header& header, Body& body, request_t& req, bool need_len) {
+            //write header and body with one gathered write without copying body into header buffer
+            static bool write_to_conn(std::shared_ptr<InetConn>& conn, string_t& header, Body& body, request_t& req, CancelContext* cancel) {
+                GatherWriteContext w;
+                w.add(header.data(), header.size());
+                w.add(body.data(), body.size());
+                return errorhandle_t::write_to_conn(conn, w, req, cancel);
+            }
+
+            //if bodylen is set, it is written as content-length instead of size of body and body is not written
+            static bool write_header_common(string_t& towrite, Header& header, Body& body, request_t& req, bool need_len, bool with_body = true, const std::uint64_t* bodylen = nullptr) {
                 for (auto& h : header) {
                     if (auto e = base_t::is_valid_field(h, req); e < 0) {
                         return false;
@@ -39,16 +62,19 @@ namespace socklib {
                     towrite += h.second;
                     towrite += "\r\n";
                 }
-                if (body.size() || need_len) {
+                std::uint64_t len = bodylen ? *bodylen : body.size();
+                if (len || need_len) {
                     if (any(req.flag & RequestFlag::header_is_small)) {
                         towrite += "content-length: ";
                     }
                     else {
                         towrite += "Content-Length: ";
                     }
-                    towrite += std::to_string(body.size()).c_str();
+                    towrite += std::to_string(len).c_str();
                     towrite += "\r\n\r\n";
-                    towrite.append(body.data(), body.size());
+                    if (with_body && !bodylen) {
+                        towrite.append(body.data(), body.size());
+                    }
                 }
                 else {
                     towrite += "\r\n";
@@ -56,7 +82,7 @@ namespace socklib {
                 return true;
             }
 
-            static bool write_request(string_t& towrite, request_t& req) {
+            static bool write_request(string_t& towrite, request_t& req, bool with_body = true) {
                 towrite = req.method;
                 towrite += ' ';
                 base_t::write_path(towrite, req);
@@ -71,12 +97,15 @@ namespace socklib {
                 towrite += urlparser_t::host_with_port(req.parsed);
                 towrite += "\r\n";
                 bool need_len = any(req.flag & RequestFlag::need_len);
-                return write_header_common(towrite, req.request, req.requestbody, req, need_len);
+                return write_header_common(towrite, req.request, req.requestbody, req, need_len, with_body);
             }
 
-            static bool write_response(string_t& towrite, request_t& req) {
+            static bool write_response(string_t& towrite, request_t& req, bool with_body = true, const std::uint64_t* bodylen = nullptr) {
                 if (req.header_version == 9) {
-                    towrite = string_t(req.responsebody.data(), req.responsebody.size());
+                    if (with_body && !bodylen) {
+                        towrite = string_t(req.responsebody.data(), req.responsebody.size());
+                    }
+                    return true;
                 }
                 else if (req.header_version == 10) {
                     towrite += "HTTP/1.0 ";
@@ -89,15 +118,123 @@ namespace socklib {
                 towrite += reason_phrase(req.statuscode);
                 towrite += "\r\n";
                 bool need_len = !any(req.flag & RequestFlag::not_need_len);
-                return write_header_common(towrite, req.response, req.responsebody, req, need_len);
+                return write_header_common(towrite, req.response, req.responsebody, req, need_len, with_body, bodylen);
             }
         };
 
+        //HttpHeaderScanner searches delimiters of HTTP/1 header 16 (SSE2) or 32 (AVX2) bytes at once
+        struct HttpHeaderScanner {
+           private:
+            static size_t lowest_bit(unsigned int mask) {
+#ifdef _MSC_VER
+                unsigned long index = 0;
+                _BitScanForward(&index, mask);
+                return index;
+#else
+                return __builtin_ctz(mask);
+#endif
+            }
+
+           public:
+            //returns index of first c in [from, size) or size if not found
+            static size_t find(const char* p, size_t from, size_t size, char c) {
+#ifdef SOCKLIB_HAS_AVX2
+                const __m256i c32 = _mm256_set1_epi8(c);
+                while (from + 32 <= size) {
+                    auto v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + from));
+                    auto mask = (unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, c32));
+                    if (mask) {
+                        return from + lowest_bit(mask);
+                    }
+                    from += 32;
+                }
+#endif
+#ifdef SOCKLIB_HAS_SSE2
+                const __m128i c16 = _mm_set1_epi8(c);
+                while (from + 16 <= size) {
+                    auto v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + from));
+                    auto mask = (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(v, c16));
+                    if (mask) {
+                        return from + lowest_bit(mask);
+                    }
+                    from += 16;
+                }
+#endif
+                if (from >= size) {
+                    return size;
+                }
+                auto found = static_cast<const char*>(::memchr(p + from, c, size - from));
+                return found ? found - p : size;
+            }
+
+            //search end of header ("\r\n\r\n" or "\n\n") from pos
+            //if found, pos is set next to it and true is returned
+            //otherwise pos is set where next search should resume after more data is appended
+            static bool find_end(const char* p, size_t size, size_t& pos) {
+                while (true) {
+                    auto lf = find(p, pos, size, '\n');
+                    if (lf == size) {
+                        pos = size;
+                        return false;
+                    }
+                    if (lf + 1 >= size) {
+                        pos = lf;
+                        return false;
+                    }
+                    if (p[lf + 1] == '\n') {
+                        pos = lf + 2;
+                        return true;
+                    }
+                    if (p[lf + 1] == '\r') {
+                        if (lf + 2 >= size) {
+                            pos = lf;
+                            return false;
+                        }
+                        if (p[lf + 2] == '\n') {
+                            pos = lf + 3;
+                            return true;
+                        }
+                    }
+                    pos = lf + 1;
+                }
+            }
+        };
+
+        //one header field as views into received header block
+        struct HttpFieldView {
+            std::string_view name;
+            std::string_view value;
+        };
+
+        //position in chunked body (RFC7230 4.1)
+        enum class ChunkState : std::uint8_t {
+            size,
+            extension,
+            size_lf,
+            data,
+            data_cr,
+            data_lf,
+            trailer,
+            trailer_field,
+            trailer_lf,
+        };
+
         struct HttpBodyInfo {
             bool has_len = false;
             size_t size = 0;
             bool chunked = false;
+            //peer closes connection after this message (Connection: close, or HTTP/1.0 response without keep-alive)
             bool close_conn = false;
+            bool keep_alive = false;
+
+            //chunked body decoding state kept across reads
+            ChunkState chunk_state = ChunkState::size;
+            //size of current chunk while reading size, and rest of it while reading data
+            size_t chunk_remain = 0;
+            bool chunk_has_digit = false;
+
+            //body received so far when has_len is set
+            size_t received = 0;
         };
 
         template <class String, class Header, class Body>
@@ -107,57 +244,112 @@ namespace socklib {
             using string_t = String;
             using header_t = Header;
             using body_t = Body;
+            using fields_t = std::vector<HttpFieldView>;
 
-            template <class Buf>
-            static bool parse_header(request_t& req, commonlib2::Reader<Buf>& r, HttpBodyInfo& body, header_t& header) {
-                using commonlib2::str_eq, commonlib2::getline, commonlib2::split;
-                while (true) {
-                    auto tmp = getline<string_t>(r, false);
-                    if (tmp.size() == 0) break;
-                    auto f = split(tmp, ":", 1);
-                    if (f.size() < 2) return false;
-                    while (f[1].size() && (f[1][0] == ' ' || f[1][0] == '\t')) f[1].erase(0, 1);
-                    //std::transform(f[0].begin(), f[0].end(), f[0].begin(), [](char c) { return std::tolower((unsigned char)c); });
-                    if (str_eq(f[0], "host", util_t::header_cmp)) {
-                        auto h = split(f[1], ":", 1);
-                        if (h.size() == 0) continue;
-                        req.parsed.host = h[0];
-                        if (h.size() == 2) {
-                            req.parsed.port = h[1];
+           private:
+            static string_t to_string(std::string_view v) {
+                return string_t(v.data(), v.size());
+            }
+
+            static std::string_view trim(std::string_view v) {
+                while (v.size() && (v.front() == ' ' || v.front() == '\t')) v.remove_prefix(1);
+                while (v.size() && (v.back() == ' ' || v.back() == '\t')) v.remove_suffix(1);
+                return v;
+            }
+
+            //line ending is "\r\n" or "\n"
+            static bool next_line(std::string_view block, size_t& pos, std::string_view& line) {
+                if (pos >= block.size()) {
+                    return false;
+                }
+                auto lf = HttpHeaderScanner::find(block.data(), pos, block.size(), '\n');
+                auto end = lf;
+                if (end > pos && block[end - 1] == '\r') {
+                    end--;
+                }
+                line = block.substr(pos, end - pos);
+                pos = lf + 1;
+                return true;
+            }
+
+            static bool parse_fields(std::string_view block, size_t pos, fields_t& fields) {
+                fields.clear();
+                std::string_view line;
+                while (next_line(block, pos, line)) {
+                    if (line.size() == 0) break;
+                    auto colon = HttpHeaderScanner::find(line.data(), 0, line.size(), ':');
+                    if (colon == line.size()) return false;
+                    fields.push_back(HttpFieldView{line.substr(0, colon), trim(line.substr(colon + 1))});
+                }
+                return true;
+            }
+
+            static void apply_fields(request_t& req, fields_t& fields, HttpBodyInfo& body) {
+                using commonlib2::str_eq;
+                constexpr auto npos = std::string_view::npos;
+                for (auto& f : fields) {
+                    if (str_eq(f.name, "host", util_t::header_cmp)) {
+                        auto colon = f.value.find(':');
+                        if (f.value.size() == 0) continue;
+                        req.parsed.host = to_string(f.value.substr(0, colon));
+                        if (colon != npos) {
+                            req.parsed.port = to_string(f.value.substr(colon + 1));
                         }
                     }
-                    else if (str_eq(f[0], "connection", util_t::header_cmp) && f[1].find("close") != ~0) {
-                        body.close_conn = true;
+                    else if (str_eq(f.name, "connection", util_t::header_cmp)) {
+                        if (f.value.find("close") != npos) {
+                            body.close_conn = true;
+                        }
+                        else if (f.value.find("keep-alive") != npos || f.value.find("Keep-Alive") != npos) {
+                            body.keep_alive = true;
+                        }
                     }
-                    else if (!body.chunked && str_eq(f[0], "transfer-encoding", util_t::header_cmp) && f[1].find("chunked") != ~0) {
+                    else if (!body.chunked && str_eq(f.name, "transfer-encoding", util_t::header_cmp) && f.value.find("chunked") != npos) {
                         body.chunked = true;
                     }
-                    else if (!body.has_len && str_eq(f[0], "content-length", util_t::header_cmp)) {
+                    else if (!body.has_len && str_eq(f.name, "content-length", util_t::header_cmp)) {
                         body.has_len = true;
-                        commonlib2::Reader(f[1]) >> body.size;
+                        body.size = 0;
+                        for (auto c : f.value) {
+                            if (c < '0' || c > '9') break;
+                            body.size = body.size * 10 + (c - '0');
+                        }
                     }
-                    header.emplace(f[0], f[1]);
                 }
-                return true;
             }
 
-            template <class Buf>
-            static bool parse_request(request_t& req, commonlib2::Reader<Buf>& r, HttpBodyInfo& body) {
-                using commonlib2::str_eq, commonlib2::getline, commonlib2::split;
-                auto status = split(getline(r, false), " ");
-                if (status.size() < 2) return false;
-                req.method = status[0];
-                auto h = split(status[1], "?", 1);
-                req.parsed.path = h[0];
-                if (h.size() == 2) {
+           public:
+            //copy fields into header
+            static void materialize(const fields_t& fields, header_t& header) {
+                for (auto& f : fields) {
+                    header.emplace(to_string(f.name), to_string(f.value));
+                }
+            }
+
+            //parse request line and fields of block
+            //fields are views into block, and they are copied into req.request only if materialize_header is true
+            static bool parse_request(request_t& req, std::string_view block, HttpBodyInfo& body, fields_t& fields, bool materialize_header = true) {
+                size_t pos = 0;
+                std::string_view line;
+                if (!next_line(block, pos, line)) return false;
+                auto sp = line.find(' ');
+                if (sp == std::string_view::npos) return false;
+                req.method = to_string(line.substr(0, sp));
+                line.remove_prefix(sp + 1);
+                sp = line.find(' ');
+                auto target = line.substr(0, sp);
+                auto q = target.find('?');
+                req.parsed.path = to_string(target.substr(0, q));
+                if (q != std::string_view::npos) {
                     req.parsed.query = "?";
-                    req.parsed.query += h[1];
+                    req.parsed.query += to_string(target.substr(q + 1));
                 }
-                if (status.size() == 3) {
-                    if (status[2] == "HTTP/1.0") {
+                if (sp != std::string_view::npos) {
+                    auto version = line.substr(sp + 1);
+                    if (version == "HTTP/1.0") {
                         req.header_version = 10;
                     }
-                    else if (status[2] == "HTTP/1.1") {
+                    else if (version == "HTTP/1.1") {
                         req.header_version = 11;
                     }
                 }
@@ -169,70 +361,193 @@ namespace socklib {
                     req.header_version = 9;
                     return true;
                 }
-                return parse_header(req, r, body, req.request);
+                if (!parse_fields(block, pos, fields)) return false;
+                apply_fields(req, fields, body);
+                if (materialize_header) {
+                    materialize(fields, req.request);
+                }
+                return true;
             }
 
-            template <class Buf>
-            static bool parse_response(request_t& req, commonlib2::Reader<Buf>& r, HttpBodyInfo& body) {
-                using commonlib2::str_eq, commonlib2::getline, commonlib2::split;
-                auto status = split(getline(r, false), " ", 2);
-                if (status.size() < 2) return false;
-                if (status[0] == "HTTP/1.1") {
+            //parse status line and fields of block
+            //fields are views into block, and they are copied into req.response only if materialize_header is true
+            static bool parse_response(request_t& req, std::string_view block, HttpBodyInfo& body, fields_t& fields, bool materialize_header = true) {
+                size_t pos = 0;
+                std::string_view line;
+                if (!next_line(block, pos, line)) return false;
+                auto sp = line.find(' ');
+                if (sp == std::string_view::npos) return false;
+                auto version = line.substr(0, sp);
+                if (version == "HTTP/1.1") {
                     req.header_version = 11;
                 }
-                else if (status[0] == "HTTP/1.0") {
+                else if (version == "HTTP/1.0") {
                     req.header_version = 10;
                 }
-                commonlib2::Reader(status[1]) >> req.statuscode;
-                return parse_header(req, r, body, req.response);
+                req.statuscode = 0;
+                for (auto c : line.substr(sp + 1)) {
+                    if (c < '0' || c > '9') break;
+                    req.statuscode = req.statuscode * 10 + (c - '0');
+                }
+                if (!parse_fields(block, pos, fields)) return false;
+                apply_fields(req, fields, body);
+                if (req.header_version < 11 && !body.keep_alive) {
+                    body.close_conn = true;
+                }
+                if (materialize_header) {
+                    materialize(fields, req.response);
+                }
+                return true;
             }
 
-            static bool read_body(request_t& req, HttpBodyInfo& bodyinfo, string_t& rawdata, body_t& body) {
-                commonlib2::Reader<string_t&> r(rawdata);
-                if (bodyinfo.chunked) {
-                    while (rawdata.size()) {
-                        r.expect("\r\n");
-                        using commonlib2::getline;
-                        bool noext = false;
-                        string_t num = "0x";
-                        getline(r, num, false, &noext);
-                        if (noext) {
-                            return true;
+           private:
+            static int hex_value(char c) {
+                if (c >= '0' && c <= '9') return c - '0';
+                if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+                if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+                return -1;
+            }
+
+            //decode chunked body in [p, end) and returns position decoding stopped
+            //decoding stops at the end of data or the end of body, or when body is invalid
+            //trailer fields are discarded
+            static const char* decode_chunked(request_t& req, HttpBodyInfo& info, const char* p, const char* end, body_t& body, bool& done, bool& err) {
+                while (p < end) {
+                    switch (info.chunk_state) {
+                        case ChunkState::size: {
+                            if (*p == ';' || *p == ' ' || *p == '\t') {
+                                info.chunk_state = ChunkState::extension;
+                                break;
+                            }
+                            if (*p == '\r') {
+                                info.chunk_state = ChunkState::size_lf;
+                                break;
+                            }
+                            if (*p == '\n') {
+                                info.chunk_state = ChunkState::size_lf;
+                                continue;
+                            }
+                            auto v = hex_value(*p);
+                            if (v < 0 || info.chunk_remain > (~size_t(0) >> 4)) {
+                                err = true;
+                                return p;
+                            }
+                            info.chunk_remain = (info.chunk_remain << 4) | v;
+                            info.chunk_has_digit = true;
+                            break;
                         }
-                        size_t chunksize = 0;
-                        commonlib2::Reader(num) >> chunksize;
-                        if (chunksize == 0) {
-                            r.expect("\r\n");
-                            rawdata.erase(0, r.readpos());
-                            req.phase = RequestPhase::body_recved;
-                            return false;
+                        case ChunkState::extension: {
+                            auto lf = static_cast<const char*>(::memchr(p, '\n', end - p));
+                            if (!lf) {
+                                return end;
+                            }
+                            p = lf;
+                            info.chunk_state = ChunkState::size_lf;
+                            continue;
                         }
-                        if (r.readable() < chunksize) {
-                            return true;
+                        case ChunkState::size_lf:
+                            if (*p != '\n' || !info.chunk_has_digit) {
+                                err = true;
+                                return p;
+                            }
+                            info.chunk_has_digit = false;
+                            info.chunk_state = info.chunk_remain ? ChunkState::data : ChunkState::trailer;
+                            break;
+                        case ChunkState::data: {
+                            size_t avail = end - p;
+                            size_t len = avail < info.chunk_remain ? avail : info.chunk_remain;
+                            if (!append_body(req, body, p, len)) {
+                                err = true;
+                                return p;
+                            }
+                            info.chunk_remain -= len;
+                            p += len;
+                            if (info.chunk_remain == 0) {
+                                info.chunk_state = ChunkState::data_cr;
+                            }
+                            continue;
                         }
-                        size_t nowsize = body.size();
-                        body.resize(nowsize + chunksize);
-                        if (r.read_byte(body.data() + nowsize, chunksize, commonlib2::translate_byte_as_is, true) < chunksize) {
-                            req.err = HttpError::read_body;
-                            req.phase = RequestPhase::error;
-                            return false;
+                        case ChunkState::data_cr:
+                            if (*p == '\n') {
+                                info.chunk_state = ChunkState::size;
+                                break;
+                            }
+                            if (*p != '\r') {
+                                err = true;
+                                return p;
+                            }
+                            info.chunk_state = ChunkState::data_lf;
+                            break;
+                        case ChunkState::data_lf:
+                            if (*p != '\n') {
+                                err = true;
+                                return p;
+                            }
+                            info.chunk_state = ChunkState::size;
+                            break;
+                        case ChunkState::trailer:
+                            if (*p == '\n') {
+                                done = true;
+                                return p + 1;
+                            }
+                            info.chunk_state = *p == '\r' ? ChunkState::trailer_lf : ChunkState::trailer_field;
+                            break;
+                        case ChunkState::trailer_field: {
+                            auto lf = static_cast<const char*>(::memchr(p, '\n', end - p));
+                            if (!lf) {
+                                return end;
+                            }
+                            p = lf + 1;
+                            info.chunk_state = ChunkState::trailer;
+                            continue;
                         }
-                        r.expect("\r\n");
-                        rawdata.erase(0, r.readpos());
-                        r.seek(0);
+                        case ChunkState::trailer_lf:
+                            if (*p != '\n') {
+                                err = true;
+                                return p;
+                            }
+                            done = true;
+                            return p + 1;
+                    }
+                    p++;
+                }
+                return p;
+            }
+
+           public:
+            static bool read_body(request_t& req, HttpBodyInfo& bodyinfo, string_t& rawdata, body_t& body) {
+                auto fail = [&] {
+                    if (req.err != HttpError::body_sink_failed) {
+                        req.err = HttpError::read_body;
+                    }
+                    req.phase = RequestPhase::error;
+                    return false;
+                };
+                if (bodyinfo.chunked) {
+                    bool done = false, err = false;
+                    auto begin = rawdata.data();
+                    auto stop = decode_chunked(req, bodyinfo, begin, begin + rawdata.size(), body, done, err);
+                    if (err) {
+                        return fail();
+                    }
+                    //consumed data is removed once per read rather than once per chunk
+                    rawdata.erase(0, stop - begin);
+                    if (done) {
+                        req.phase = RequestPhase::body_recved;
+                        return false;
                     }
                 }
                 else if (bodyinfo.has_len) {
-                    if (rawdata.size() >= bodyinfo.size) {
-                        body.resize(bodyinfo.size);
-                        if (r.read_byte(body.data(), bodyinfo.size, commonlib2::translate_byte_as_is, true) < bodyinfo.size) {
-                            req.err = HttpError::read_body;
-                            req.phase = RequestPhase::error;
-                        }
-                        else {
-                            req.phase = RequestPhase::body_recved;
-                        }
-                        rawdata.erase(0, bodyinfo.size);
+                    //body is taken as it arrives so that rawdata doesn't hold whole body
+                    size_t rest = bodyinfo.size - bodyinfo.received;
+                    size_t len = rawdata.size() < rest ? rawdata.size() : rest;
+                    if (!append_body(req, body, rawdata.data(), len)) {
+                        return fail();
+                    }
+                    bodyinfo.received += len;
+                    rawdata.erase(0, len);
+                    if (bodyinfo.received == bodyinfo.size) {
+                        req.phase = RequestPhase::body_recved;
                         return false;
                     }
                 }
@@ -245,8 +560,8 @@ namespace socklib {
                         req.phase = RequestPhase::body_recved;
                         return false;
                     }
-                    for (size_t i = 0; i < rawdata.size(); i++) {
-                        body.push_back(rawdata[i]);
+                    if (!append_body(req, body, rawdata.data(), rawdata.size())) {
+                        return fail();
                     }
                     rawdata.clear();
                 }
@@ -271,6 +586,43 @@ namespace socklib {
             HttpBodyInfo bodyinfo;
             string_t rawdata;
             bool server = false;
+            //if set, server stops parsing when rawdata begins with it (used to detect HTTP/2 connection preface)
+            const char* preface = nullptr;
+            bool preface_matched = false;
+            //header block of last message and its fields as views into it
+            string_t headerblock;
+            typename httpparser_t::fields_t fields;
+            //if set, fields are not copied into req.request (server) or req.response (client) until materialize() is called
+            bool lazy_header = false;
+            //position in rawdata where search of end of header resumes
+            size_t scanned = 0;
+
+            //prepare for next message on keep-alive connection
+            //rawdata is kept because it may hold beginning of next message
+            void reset() {
+                nolen = false;
+                eos = false;
+                bodyinfo = HttpBodyInfo{};
+                preface_matched = false;
+                scanned = 0;
+            }
+
+            //copy fields of last message into req.request (server) or req.response (client)
+            void materialize() {
+                httpparser_t::materialize(fields, server ? req.request : req.response);
+            }
+
+            //value of first field named name (case insensitive) in last message
+            //returns empty view if not found
+            std::string_view field(std::string_view name) const {
+                using util_t = HttpUtil<String>;
+                for (auto& f : fields) {
+                    if (commonlib2::str_eq(f.name, name, util_t::header_cmp)) {
+                        return f.value;
+                    }
+                }
+                return std::string_view();
+            }
 
             virtual bool require() override {
                 return !eos;
@@ -281,50 +633,55 @@ namespace socklib {
             }
 
             virtual void append(const char* read, size_t size) override {
-                commonlib2::Reader<string_t&> r(rawdata);
-                size_t last = rawdata.size();
                 rawdata.append(read, size);
+                if (preface && server && req.phase == RequestPhase::request_recving) {
+                    auto len = ::strlen(preface);
+                    auto cmp = rawdata.size() < len ? rawdata.size() : len;
+                    if (::memcmp(rawdata.data(), preface, cmp) == 0) {
+                        if (cmp == len) {
+                            preface_matched = true;
+                            eos = true;
+                        }
+                        return;
+                    }
+                    preface = nullptr;
+                }
                 if (req.phase == RequestPhase::request_recving || req.phase == RequestPhase::response_recving) {
-                    r.seek(last);
-                    auto parse_header = [&, this] {
-                        r.seek(0);
-                        if (server) {
-                            if (!httpparser_t::parse_request(req, r, bodyinfo)) {
-                                eos = true;
-                                req.phase = RequestPhase::error;
-                                return false;
-                            }
-                            if (req.header_version == 9) {
-                                eos = true;
-                                req.phase = RequestPhase::body_recved;
-                            }
-                            else {
-                                req.phase = RequestPhase::request_recved;
-                            }
+                    //search is resumed where previous append stopped
+                    size_t end = scanned;
+                    if (!HttpHeaderScanner::find_end(rawdata.data(), rawdata.size(), end)) {
+                        scanned = end;
+                        return;
+                    }
+                    scanned = 0;
+                    //header block is moved out of rawdata to keep fields valid while body is received
+                    headerblock.swap(rawdata);
+                    rawdata.assign(headerblock.data() + end, headerblock.size() - end);
+                    headerblock.resize(end);
+                    std::string_view block(headerblock.data(), headerblock.size());
+                    if (server) {
+                        if (!httpparser_t::parse_request(req, block, bodyinfo, fields, !lazy_header)) {
+                            eos = true;
+                            req.phase = RequestPhase::error;
+                            return;
+                        }
+                        if (req.header_version == 9) {
+                            eos = true;
+                            req.phase = RequestPhase::body_recved;
                         }
                         else {
-                            if (!httpparser_t::parse_response(req, r, bodyinfo)) {
-                                eos = true;
-                                req.phase = RequestPhase::error;
-                                return false;
-                            }
-                            req.phase = RequestPhase::response_recved;
+                            req.phase = RequestPhase::request_recved;
                         }
-                        rawdata.erase(0, r.readpos());
-                        nolen = !bodyinfo.chunked && !bodyinfo.has_len;
-                        return true;
-                    };
-                    while (!r.ceof()) {
-                        if (r.achar() == '\r' || r.achar() == '\n') {
-                            if (r.expect("\r\n\r\n") || r.expect("\n\n")) {
-                                if (!parse_header()) {
-                                    return;
-                                }
-                                break;
-                            }
+                    }
+                    else {
+                        if (!httpparser_t::parse_response(req, block, bodyinfo, fields, !lazy_header)) {
+                            eos = true;
+                            req.phase = RequestPhase::error;
+                            return;
                         }
-                        r.increment();
+                        req.phase = RequestPhase::response_recved;
                     }
+                    nolen = !bodyinfo.chunked && !bodyinfo.has_len;
                 }
                 if (req.phase == RequestPhase::request_recved) {
                     if (!httpparser_t::read_body(req, bodyinfo, rawdata, req.requestbody)) {
@@ -358,11 +715,11 @@ namespace socklib {
                     req.method = "GET";
                 }
                 string_t towrite;
-                if (!headerwriter_t::write_request(towrite, req)) {
+                if (!headerwriter_t::write_request(towrite, req, false)) {
                     req.phase = RequestPhase::error;
                     return false;
                 }
-                if (!headerwriter_t::write_to_conn(conn, towrite, req, cancel)) {
+                if (!headerwriter_t::write_to_conn(conn, towrite, req.requestbody, req, cancel)) {
                     req.phase = RequestPhase::error;
                 }
                 req.phase = RequestPhase::request_sent;
@@ -376,6 +733,7 @@ namespace socklib {
                     return false;
                 }
                 if (read.req.phase == RequestPhase::request_sent) {
+                    read.reset();
                     read.req.phase = RequestPhase::response_recving;
                 }
                 read.nolen = false;
@@ -383,7 +741,7 @@ namespace socklib {
                 if (!conn->read(read, cancel)) {
                     return read.nolen;
                 }
-                return true;
+                return read.req.phase != RequestPhase::error;
             }
         };
 
@@ -393,11 +751,13 @@ namespace socklib {
             using request_t = typename base_t::request_t;
             using httpwriter_t = HttpHeaderWriter<String, Header, Body>;
             using readcontext_t = Http1ReadContext<String, Header, Body>;
+            using errorhandle_t = ErrorHandler<String, Header, Body>;
             using string_t = String;
 
             static bool request(std::shared_ptr<InetConn>& conn, readcontext_t& read, CancelContext* cancel = nullptr) {
                 if (!conn) return false;
                 if (read.req.phase == RequestPhase::idle) {
+                    read.reset();
                     read.req.phase = RequestPhase::request_recving;
                 }
                 read.nolen = false;
@@ -405,6 +765,9 @@ namespace socklib {
                 if (!conn->read(read, cancel)) {
                     return read.nolen;
                 }
+                if (read.req.phase == RequestPhase::error) {
+                    return false;
+                }
                 ConnStat stat;
                 conn->stat(stat);
                 if (any(stat.status & ConnStatus::secure)) {
@@ -426,15 +789,46 @@ namespace socklib {
                     return false;
                 }
                 string_t towrite;
-                if (!httpwriter_t::write_response(towrite, req)) {
+                if (!httpwriter_t::write_response(towrite, req, false)) {
                     req.phase = RequestPhase::error;
                     return false;
                 }
-                if (!httpwriter_t::write_to_conn(conn, towrite, req, cancel)) {
+                if (!httpwriter_t::write_to_conn(conn, towrite, req.responsebody, req, cancel)) {
                     req.phase = RequestPhase::error;
+                    return false;
                 }
                 req.phase = RequestPhase::idle;
-                return false;
+                return true;
+            }
+
+            //response with size bytes of file fd from offset as body
+            //body is sent by InetConn::send_file, so it is not copied into user space on plain tcp or kTLS connection
+            static bool response_file(std::shared_ptr<InetConn>& conn, request_t& req, int fd, std::uint64_t offset, size_t size, CancelContext* cancel = nullptr) {
+                if (!conn) return false;
+                if (req.statuscode < 100 || req.statuscode > 599) {
+                    req.statuscode = 500;
+                }
+                if (req.phase != RequestPhase::body_recved) {
+                    req.err = HttpError::invalid_phase;
+                    return false;
+                }
+                string_t towrite;
+                std::uint64_t len = size;
+                if (!httpwriter_t::write_response(towrite, req, false, &len)) {
+                    req.phase = RequestPhase::error;
+                    return false;
+                }
+                if (towrite.size() && !httpwriter_t::write_to_conn(conn, towrite, req, cancel)) {
+                    req.phase = RequestPhase::error;
+                    return false;
+                }
+                if (!conn->send_file(fd, offset, size, cancel)) {
+                    errorhandle_t::on_error(req, 0, cancel, "send_file");
+                    req.phase = RequestPhase::error;
+                    return false;
+                }
+                req.phase = RequestPhase::idle;
+                return true;
             }
         };
 
@@ -7,6 +7,9 @@
 
 #pragma once
 #include "http2_frames.h"
+#include <deque>
+#include <vector>
+#include <algorithm>
 namespace socklib {
     namespace v2 {
 #define H2TYPE_PARAMS template <class String, template <class...> class Map, class Header, class Body, class Table>
@@ -23,7 +26,11 @@ namespace socklib {
 
             static bool update(h2request_t& ctx, dataframe_t* frame) {
                 if (!frame) return false;
+                //padding is also subject to flow control
                 auto down = frame->payload().size();
+                if (frame->is_set(H2Flag::padded)) {
+                    down += frame->padlen() + 1;
+                }
                 auto id = frame->get_id();
                 stream_t& stream = ctx.streams[id];
                 stream.local_window -= down;
@@ -49,13 +56,60 @@ namespace socklib {
                 stream.local_window += up;
             }
 
+            //count received DATA into bandwidth-delay product sample
+            //returns true if PING should be sent to start new sample
+            static bool sample(h2request_t& ctx, size_t down) {
+                auto& est = ctx.estimator;
+                if (!est.adaptive) {
+                    return false;
+                }
+                if (est.ping_inflight) {
+                    est.sample += down;
+                    return false;
+                }
+                if (est.conn_window >= h2_max_receive_window) {
+                    return false;
+                }
+                est.ping_inflight = true;
+                est.sample = down;
+                est.ping_sent = std::chrono::steady_clock::now();
+                return true;
+            }
+
+            //finish sample by PING ACK
+            //returns new receive window (not larger than limit) if peer used most of window in one round trip, otherwise 0
+            //window is not grown unless bandwidth also grows, because round trip time grows as data is queued
+            static std::int64_t estimate(h2request_t& ctx, std::int64_t limit) {
+                auto& est = ctx.estimator;
+                est.ping_inflight = false;
+                est.rtt = std::chrono::steady_clock::now() - est.ping_sent;
+                auto usec = std::chrono::duration_cast<std::chrono::microseconds>(est.rtt).count();
+                double bandwidth = (double)est.sample / (usec > 0 ? usec : 1);
+                if (bandwidth < est.bandwidth) {
+                    return 0;
+                }
+                est.bandwidth = bandwidth;
+                if (est.sample * 3 < est.conn_window * 2) {
+                    return 0;
+                }
+                auto window = est.sample * 2;
+                if (window > limit) {
+                    window = limit;
+                }
+                return window > est.conn_window ? window : 0;
+            }
+
             static bool resize(h2request_t& ctx, settingsframe_t* frame) {
                 if (!frame) return false;
                 auto& settings = frame->new_settings();
                 if (auto found = settings.find(key(H2PredefinedSetting::initial_window_size)); found != settings.end()) {
                     std::uint32_t current_initial = frame->old_settings()[key(H2PredefinedSetting::initial_window_size)];
-                    std::uint32_t new_initial = found->size;
+                    std::uint32_t new_initial = found->second;
                     for (auto& stpair : ctx.streams) {
+                        //SETTINGS_INITIAL_WINDOW_SIZE doesn't affect connection window
+                        if (stpair.first == 0) {
+                            continue;
+                        }
                         //refer URL below (Qiita) (Japanese)
                         //https://qiita.com/Jxck_/items/622162ad8bcb69fa043d#%E9%80%94%E4%B8%AD%E3%81%A7%E3%81%AE-settings-frame
                         stream_t& stream = stpair.second;
@@ -140,12 +194,33 @@ namespace socklib {
                 return true;
             }
 
-            static H2Err accept_frame(std::shared_ptr<frame_t>& frame, h2request_t& ctx) {
-                if (!frame) return false;
-                frame_t& f = *frame;
+            //accept stream opened by client (server side)
+            static H2Err accept_new_stream(h2request_t& ctx, std::int32_t id) {
+                if (!verify_id(id, false) || id <= (std::int64_t)ctx.max_stream) {
+                    ctx.err = H2Error::protocol;
+                    return ctx.err;
+                }
+                set_initial_window_size(ctx.streams[id], ctx);
+                ctx.max_stream = id;
+                return true;
+            }
+
+            //forget stream which is closed in both direction
+            static void close_stream(h2request_t& ctx, std::int32_t id) {
+                if (auto found = ctx.streams.find(id); found != ctx.streams.end() && found->second.state == H2StreamState::closed) {
+                    ctx.streams.erase(found);
+                }
+            }
+
+            static H2Err accept_frame(frame_t& f, h2request_t& ctx) {
                 std::int32_t id = f.get_id();
-                if (auto found = ctx.streams.find(id); found == ctx.streams.end()) {
-                    if (ctx.max_stream < id) {
+                auto found = ctx.streams.find(id);
+                if (ctx.server && f.header() && (found == ctx.streams.end() || found->second.state == H2StreamState::idle)) {
+                    return accept_new_stream(ctx, id);
+                }
+                if (found == ctx.streams.end()) {
+                    //PRIORITY frame can be sent on idle stream
+                    if (id > 0 && ctx.max_stream < (std::uint64_t)id && !f.priority()) {
                         ctx.err = H2Error::protocol;
                         return ctx.err;
                     }
@@ -164,7 +239,7 @@ namespace socklib {
 
             static bool header_sendable(H2StreamState state, bool server) {
                 if (server) {
-                    return state == H2StreamState::half_closed_remote;
+                    return state == H2StreamState::open || state == H2StreamState::half_closed_remote;
                 }
                 else {
                     return state == H2StreamState::idle;
@@ -172,11 +247,12 @@ namespace socklib {
             }
 
             static bool header_recvable(H2StreamState state, bool server) {
+                //open is for trailers
                 if (server) {
-                    return state == H2StreamState::idle;
+                    return state == H2StreamState::idle || state == H2StreamState::open;
                 }
                 else {
-                    return state == H2StreamState::half_closed_local;
+                    return state == H2StreamState::open || state == H2StreamState::half_closed_local;
                 }
             }
 
@@ -204,14 +280,14 @@ namespace socklib {
 
             static H2StreamState sent_push_promise(H2StreamState state) {
                 if (state == H2StreamState::idle) {
-                    state = H2StreamState::reserved_local;
+                    return H2StreamState::reserved_local;
                 }
                 return H2StreamState::closed;
             }
 
             static H2StreamState recv_push_promise(H2StreamState state) {
                 if (state == H2StreamState::idle) {
-                    state = H2StreamState::reserved_remote;
+                    return H2StreamState::reserved_remote;
                 }
                 return H2StreamState::closed;
             }
@@ -230,7 +306,7 @@ namespace socklib {
                 else if (state == H2StreamState::reserved_remote) {
                     return H2StreamState::half_closed_local;
                 }
-                return H2StreamState::closed;
+                return state;
             }
         };
 
@@ -269,13 +345,9 @@ namespace socklib {
                     else if (e == 0) {
                         continue;
                     }
-                    string_t key, value;
-                    auto to_lower = [](auto& base, auto& str) {
-                        std::transform(base.begin(), base.end(), std::back_inserter(str), [](unsigned char c) { return std::tolower(c); });
-                    };
-                    to_lower(h.first, key);
-                    to_lower(h.second, value);
-                    towrite.emplace(key, value);
+                    string_t key;
+                    std::transform(h.first.begin(), h.first.end(), std::back_inserter(key), [](unsigned char c) { return std::tolower(c); });
+                    towrite.emplace(key, h.second);
                 }
                 return H2Error::none;
             };
@@ -343,8 +415,14 @@ namespace socklib {
                 return e;
             }
 
+            static size_t min_data_window(h2request_t& ctx) {
+                size_t half = ctx.remote_settings[key(H2PredefinedSetting::initial_window_size)] / 2;
+                return half < h2_min_data_window ? half : h2_min_data_window;
+            }
+
+            //at most limit bytes of body is written at once
             static H2Err write_data(conn_t& conn, h1request_t& req, h2request_t& ctx, bool closeable = true,
-                                    CancelContext* cancel = nullptr, std::uint8_t* padlen = nullptr) {
+                                    CancelContext* cancel = nullptr, std::uint8_t* padlen = nullptr, size_t limit = ~size_t(0)) {
                 F(H2DataFrame)
                 dframe;
                 if (req.streamid <= 0) {
@@ -374,6 +452,9 @@ namespace socklib {
                     return true;
                 }
                 size_t remainsize = total - stream->data_progress;
+                if (remainsize > limit) {
+                    remainsize = limit;
+                }
                 size_t window = stream0.remote_window < stream->remote_window ? stream0.remote_window : stream->remote_window;
                 size_t opt = 0;
                 if (padlen) {
@@ -382,6 +463,12 @@ namespace socklib {
                         return H2Error::need_window_update;
                     }
                 }
+                //don't cut body into tiny frames while window is nearly exhausted (silly window syndrome)
+                //consumed window is returned by peer, so window grows back to min_window
+                size_t min_window = min_data_window(ctx);
+                if (window < opt + (remainsize < min_window ? remainsize : min_window)) {
+                    return H2Error::need_window_update;
+                }
                 size_t towrite = remainsize < window - opt ? remainsize + opt : window;
                 std::string_view view(body.data() + stream->data_progress, towrite - opt);
                 auto check_end = [&] {
@@ -390,10 +477,7 @@ namespace socklib {
                 if (check_end() && closeable) {
                     dframe.add_flag(H2Flag::end_stream);
                 }
-                for (auto c : view) {
-                    dframe.payload().push_back(c);
-                }
-                auto e = basewriter_t::write(conn, dframe, req, ctx, cancel);
+                auto e = basewriter_t::write_data(conn, dframe, view, req, ctx, cancel);
                 if (e) {
                     window_updater_t::update(ctx, *stream, stream0, (std::int32_t)towrite);
                     if (check_end()) {
@@ -481,11 +565,11 @@ namespace socklib {
                     return ctx.err;
                 }
                 if (padlen) {
-                    hframe.set_padding(*padlen);
-                    hframe.add_flag(H2Flag::padded);
+                    pframe.set_padding(*padlen);
+                    pframe.add_flag(H2Flag::padded);
                 }
                 auto& towrite = pframe.header_map();
-                if (auto e = set_http2_header(towrite, promiseheader, req); !e) {
+                if (auto e = set_http2_header(towrite, promiseheader, req, ctx); !e) {
                     return e;
                 }
                 pframe.add_flag(H2Flag::end_headers);
@@ -497,7 +581,7 @@ namespace socklib {
             }
 
             static H2Err write_ping(conn_t& conn, h1request_t& req, h2request_t& ctx, bool ack,
-                                    CancelContext* cancel = nullptr, std::uint8_t* data = nullptr) {
+                                    CancelContext* cancel = nullptr, const std::uint8_t* data = nullptr) {
                 F(H2PingFrame)
                 pframe;
                 pframe.set_id(0);
@@ -522,7 +606,16 @@ namespace socklib {
                 gframe.set_code(errorcode);
                 gframe.optdata() = additional;
                 ctx.streams[0].state = H2StreamState::closed;
-                return basewriter_t::write(conn, gframe, req, ctx, cancel);
+                //connection is usually closed after GOAWAY, so buffered frames are written now
+                if (auto e = basewriter_t::write(conn, gframe, req, ctx, cancel); !e) {
+                    return e;
+                }
+                return basewriter_t::flush(conn, req, ctx, cancel);
+            }
+
+            //write frames buffered in ctx
+            static H2Err flush(conn_t& conn, h1request_t& req, h2request_t& ctx, CancelContext* cancel = nullptr) {
+                return basewriter_t::flush(conn, req, ctx, cancel);
             }
 
             using window_updater_t = WindowUpdater TEMPLATE_PARAM;
@@ -546,6 +639,98 @@ namespace socklib {
                 }
                 return e;
             }
+
+            //give window consumed by received DATA frame back to peer
+            //WINDOW_UPDATE is sent when consumed window exceeds 1/h2_window_update_divisor of receive window
+            //if stream is set, window of req.streamid is also updated unless it is the last DATA of the stream
+            static H2Err write_window_consumed(conn_t& conn, h1request_t& req, h2request_t& ctx, F(H2DataFrame) & dframe, bool stream,
+                                               CancelContext* cancel = nullptr) {
+                size_t consumed = dframe.payload().size();
+                if (dframe.is_set(H2Flag::padded)) {
+                    consumed += dframe.padlen() + 1;
+                }
+                if (!consumed) {
+                    return true;
+                }
+                if (window_updater_t::sample(ctx, consumed)) {
+                    if (auto e = write_ping(conn, req, ctx, false, cancel, h2_bdp_ping_payload); !e) {
+                        return e;
+                    }
+                }
+                stream_t& stream0 = ctx.streams[0];
+                stream0.window_consumed += consumed;
+                if (stream0.window_consumed >= ctx.estimator.conn_window / h2_window_update_divisor) {
+                    if (auto e = write_window_update(conn, req, ctx, (std::int32_t)stream0.window_consumed, true, cancel); !e) {
+                        return e;
+                    }
+                    stream0.window_consumed = 0;
+                }
+                if (!stream || dframe.is_set(H2Flag::end_stream)) {
+                    return true;
+                }
+                auto found = ctx.streams.find(req.streamid);
+                if (found == ctx.streams.end()) {
+                    return true;
+                }
+                stream_t& st = found->second;
+                st.window_consumed += consumed;
+                if (st.window_consumed >= ctx.local_settings[key(H2PredefinedSetting::initial_window_size)] / h2_window_update_divisor) {
+                    if (auto e = write_window_update(conn, req, ctx, (std::int32_t)st.window_consumed, false, cancel); !e) {
+                        return e;
+                    }
+                    st.window_consumed = 0;
+                }
+                return true;
+            }
+
+            //receive window is limited by kernel receive buffer
+            //otherwise peer may be blocked on sending DATA while this side is blocked on sending body and neither reads
+            static std::int64_t max_receive_window(conn_t& conn) {
+                std::int64_t limit = h2_max_receive_window;
+                ConnStat st;
+                if (conn && conn->stat(st) && any(st.status & ConnStatus::has_fd)) {
+                    //kernel doubles SO_RCVBUF for bookkeeping overhead, so about half of it is for data
+                    auto size = (std::int64_t)recv_buffer_size(st.net.sock) / 2;
+                    if (size && size < limit) {
+                        limit = size;
+                    }
+                }
+                return limit;
+            }
+
+            //grow receive window by bandwidth-delay product estimated with PING ACK
+            //connection window is grown by WINDOW_UPDATE and stream windows are grown by SETTINGS_INITIAL_WINDOW_SIZE
+            static H2Err write_window_estimated(conn_t& conn, h1request_t& req, h2request_t& ctx, F(H2PingFrame) & ack,
+                                                CancelContext* cancel = nullptr) {
+                if (!ctx.estimator.ping_inflight || ::memcmp(ack.payload(), h2_bdp_ping_payload, 8) != 0) {
+                    return true;
+                }
+                auto window = window_updater_t::estimate(ctx, max_receive_window(conn));
+                if (!window) {
+                    return true;
+                }
+                auto& initial = ctx.local_settings[key(H2PredefinedSetting::initial_window_size)];
+                if (window > (std::int64_t)initial) {
+                    std::int64_t delta = window - initial;
+                    settings_t settings;
+                    settings[key(H2PredefinedSetting::initial_window_size)] = (std::uint32_t)window;
+                    if (auto e = write_settings(conn, req, ctx, false, settings, cancel); !e) {
+                        return e;
+                    }
+                    //peer adjusts its send window of all streams by difference of SETTINGS_INITIAL_WINDOW_SIZE
+                    for (auto& st : ctx.streams) {
+                        if (st.first != 0) {
+                            st.second.local_window += delta;
+                        }
+                    }
+                }
+                std::int64_t delta = window - ctx.estimator.conn_window;
+                if (auto e = write_window_update(conn, req, ctx, (std::int32_t)delta, true, cancel); !e) {
+                    return e;
+                }
+                ctx.estimator.conn_window = window;
+                return true;
+            }
 #undef F
         };
 
@@ -559,12 +744,37 @@ namespace socklib {
             using manager_t = StreamManager TEMPLATE_PARAM;
             using stream_t = H2Stream;
 
-            static H2Err accept(std::shared_ptr<frame_t>& frame, h2request_t& ctx) {
+            //stream depending on itself is treated as depending on nothing
+            //if new parent depends on the stream, the parent is moved to former parent of the stream first (RFC7540 5.3.3)
+            //so that dependencies never make a cycle
+            static void set_weight(h2request_t& ctx, std::int32_t id, const H2Weight& weight) {
+                stream_t& stream = ctx.streams[id];
+                auto parent = weight.depends_id;
+                if (parent == id) {
+                    parent = 0;
+                }
+                auto ancestor = parent;
+                for (size_t i = 0; ancestor != 0 && i < ctx.streams.size(); i++) {
+                    auto found = ctx.streams.find(ancestor);
+                    if (found == ctx.streams.end()) {
+                        break;
+                    }
+                    if (found->second.weight.depends_id == id) {
+                        ctx.streams[parent].weight.depends_id = stream.weight.depends_id;
+                        break;
+                    }
+                    ancestor = found->second.weight.depends_id;
+                }
+                stream.weight = weight;
+                stream.weight.depends_id = parent;
+            }
+
+            static H2Err accept(frame_t& frame, h2request_t& ctx) {
                 if (auto e = manager_t::accept_frame(frame, ctx); !e) {
                     return e;
                 }
-                stream_t& stream = ctx.streams[frame->get_id()];
-                if (F(H2HeaderFrame)* h = frame->header()) {
+                stream_t& stream = ctx.streams[frame.get_id()];
+                if (F(H2HeaderFrame)* h = frame.header()) {
                     if (!checker_t::header_recvable(stream.state, ctx.server)) {
                         ctx.err = H2Error::protocol;
                         return ctx.err;
@@ -573,14 +783,23 @@ namespace socklib {
                     if (h->is_set(H2Flag::end_stream)) {
                         stream.state = checker_t::recv_endstream(stream.state);
                     }
+                    H2Weight weight;
+                    if (h->get_weight(weight)) {
+                        set_weight(ctx, frame.get_id(), weight);
+                    }
                 }
-                else if (F(H2DataFrame)* d = frame->data()) {
+                else if (F(H2PriorityFrame)* p = frame.priority()) {
+                    H2Weight weight;
+                    p->get_weight(weight);
+                    set_weight(ctx, frame.get_id(), weight);
+                }
+                else if (F(H2DataFrame)* d = frame.data()) {
                     window_updater_t::update(ctx, d);
                     if (d->is_set(H2Flag::end_stream)) {
                         stream.state = checker_t::recv_endstream(stream.state);
                     }
                 }
-                else if (F(H2PushPromiseFrame)* p = frame->push_promise()) {
+                else if (F(H2PushPromiseFrame)* p = frame.push_promise()) {
                     auto promise = p->id();
                     if (!manager_t::make_new_stream(ctx, promise, true)) {
                         return ctx.err;
@@ -588,11 +807,11 @@ namespace socklib {
                     stream_t& promised = ctx.streams[promise];
                     promised.state = checker_t::recv_push_promise(promised.state);
                 }
-                else if (F(H2RstStreamFrame)* r = frame->rst_stream()) {
+                else if (F(H2RstStreamFrame)* r = frame.rst_stream()) {
                     stream.errorcode = r->code();
                     stream.state = checker_t::handle_rst_stream();
                 }
-                else if (F(H2WindowUpdateFrame)* f = frame->window_update()) {
+                else if (F(H2WindowUpdateFrame)* f = frame.window_update()) {
                     window_updater_t::update(ctx, f);
                 }
                 return true;
@@ -600,10 +819,182 @@ namespace socklib {
 #undef F
         };
 
+        //H2Scheduler chooses stream whose DATA is sent next from pending streams
+        //stream of smaller urgency is sent first, and stream whose parent (RFC7540 dependency) can send is not sent
+        //among the rest, stream which has least virtual time is sent, and virtual time of incremental stream advances by size / weight
+        //so that large body doesn't starve small ones. non-incremental stream keeps its virtual time until its body is sent,
+        //and ties are sent in order of stream id. exclusive flag of dependency is not considered
+        H2TYPE_PARAMS
+        struct H2Scheduler {
+            using h1request_t = RequestContext<String, Header, Body>;
+            using h2request_t = Http2RequestContext TEMPLATE_PARAM;
+            using conn_t = std::shared_ptr<InetConn>;
+            using writer_t = H2FrmaeWriter TEMPLATE_PARAM;
+            using stream_t = H2Stream;
+
+            //read Priority header (RFC 9218) like "u=1, i"
+            //absent header or parameter is default value (u=3, i=?0), so RFC7540 weight is used only by incremental streams
+            static void set_priority(stream_t& stream, const Header& header) {
+                stream.urgency = h2_default_urgency;
+                stream.incremental = false;
+                auto found = header.find("priority");
+                if (found == header.end()) {
+                    return;
+                }
+                auto& value = found->second;
+                size_t i = 0;
+                while (i < value.size()) {
+                    while (i < value.size() && value[i] == ' ') {
+                        i++;
+                    }
+                    size_t end = i;
+                    while (end < value.size() && value[end] != ',') {
+                        end++;
+                    }
+                    auto len = end - i;
+                    if (len == 3 && value[i] == 'u' && value[i + 1] == '=' && value[i + 2] >= '0' && value[i + 2] <= '7') {
+                        stream.urgency = value[i + 2] - '0';
+                    }
+                    else if (len >= 1 && value[i] == 'i') {
+                        //"i" and "i=?1" are true, "i=?0" is false
+                        stream.incremental = !(len == 4 && value[i + 3] == '0');
+                    }
+                    i = end + 1;
+                }
+            }
+
+           private:
+            static bool prior(std::int32_t aid, const stream_t& a, std::int32_t bid, const stream_t& b) {
+                if (a.urgency != b.urgency) {
+                    return a.urgency < b.urgency;
+                }
+                if (a.vtime != b.vtime) {
+                    return a.vtime < b.vtime;
+                }
+                return aid < bid;
+            }
+
+            static void advance(h2request_t& ctx, stream_t& stream, size_t sent) {
+                ctx.vclock = stream.vtime;
+                if (stream.incremental) {
+                    stream.vtime += sent * 256 / ((std::uint64_t)stream.weight.weight + 1);
+                }
+            }
+
+           public:
+            //write first DATA of req directly, at most h2_schedule_quantum bytes
+            //if body remains, H2Error::need_window_update is returned and stream should be added to pending streams
+            static H2Err start(conn_t& conn, h2request_t& ctx, h1request_t& req, CancelContext* cancel = nullptr) {
+                stream_t& stream = ctx.streams[req.streamid];
+                //stream which starts to send is not given priority over others by its old virtual time
+                if (stream.vtime < ctx.vclock) {
+                    stream.vtime = ctx.vclock;
+                }
+                auto progress = stream.data_progress;
+                auto err = writer_t::write_data(conn, req, ctx, true, cancel, nullptr, h2_schedule_quantum);
+                advance(ctx, stream, stream.data_progress - progress);
+                return err;
+            }
+
+            //send DATA of pending streams until every stream is sent or blocked by flow control, or budget bytes are sent
+            //get(id) returns request of stream or nullptr if it is no longer sending
+            //done(id, req) is called when body of stream is completely sent
+            //while several streams can send, each stream sends at most h2_schedule_quantum bytes in its turn
+            template <class Get, class Done>
+            static H2Err schedule(conn_t& conn, h2request_t& ctx, std::deque<std::int32_t>& sending, Get&& get, Done&& done,
+                                  CancelContext* cancel = nullptr, size_t budget = ~size_t(0)) {
+                struct Pending {
+                    std::int32_t id;
+                    h1request_t* req;
+                    stream_t* stream;
+                    bool blocked;
+                };
+                stream_t& stream0 = ctx.streams[0];
+                if (sending.empty() || stream0.remote_window <= 0) {
+                    return true;
+                }
+                std::vector<Pending> pending;
+                for (auto id : sending) {
+                    auto req = get(id);
+                    if (!req) {
+                        continue;
+                    }
+                    pending.push_back(Pending{id, req, &ctx.streams[id], false});
+                }
+                auto parent_sendable = [&](const Pending& p) {
+                    auto parent = p.stream->weight.depends_id;
+                    if (parent == 0) {
+                        return false;
+                    }
+                    for (auto& q : pending) {
+                        if (q.id == parent) {
+                            return !q.blocked;
+                        }
+                    }
+                    return false;
+                };
+                H2Err err = true;
+                while (budget && stream0.remote_window > 0) {
+                    Pending* next = nullptr;
+                    size_t sendable = 0;
+                    for (auto& p : pending) {
+                        if (p.blocked || parent_sendable(p)) {
+                            continue;
+                        }
+                        sendable++;
+                        if (!next || prior(p.id, *p.stream, next->id, *next->stream)) {
+                            next = &p;
+                        }
+                    }
+                    if (!next) {
+                        break;
+                    }
+                    size_t limit = sendable == 1 || budget < h2_schedule_quantum ? budget : h2_schedule_quantum;
+                    auto progress = next->stream->data_progress;
+                    err = writer_t::write_data(conn, *next->req, ctx, true, cancel, nullptr, limit);
+                    size_t sent = next->stream->data_progress - progress;
+                    advance(ctx, *next->stream, sent);
+                    budget -= sent < budget ? sent : budget;
+                    if (err) {
+                        auto id = next->id;
+                        auto& req = *next->req;
+                        pending.erase(pending.begin() + (next - pending.data()));
+                        done(id, req);
+                        continue;
+                    }
+                    if (err != H2Error::need_window_update) {
+                        break;
+                    }
+                    err = true;
+                    if (sent == 0) {
+                        next->blocked = true;
+                    }
+                }
+                sending.clear();
+                for (auto& p : pending) {
+                    sending.push_back(p.id);
+                }
+                return err;
+            }
+        };
+
+        H2TYPE_PARAMS
+        struct Http2ClientContext {
+            using h1request_t = RequestContext<String, Header, Body>;
+            //requests in flight and responses not taken yet
+            Map<std::int32_t, h1request_t> exchanges;
+            //streams whose response is completely received or failed
+            std::deque<std::int32_t> done;
+            //streams which have request body to send
+            std::deque<std::int32_t> sending;
+            bool goaway_recved = false;
+        };
+
         H2TYPE_PARAMS
         struct Http2Client {
             using h1request_t = RequestContext<String, Header, Body>;
             using h2request_t = Http2RequestContext TEMPLATE_PARAM;
+            using client_t = Http2ClientContext TEMPLATE_PARAM;
             using conn_t = std::shared_ptr<InetConn>;
             using errorhandler_t = ErrorHandler<String, Header, Body>;
             using writer_t = H2FrmaeWriter TEMPLATE_PARAM;
@@ -612,11 +1003,24 @@ namespace socklib {
             using frame_t = H2Frame TEMPLATE_PARAM;
             using accepter_t = H2FrameAccepter TEMPLATE_PARAM;
             using manager_t = StreamManager TEMPLATE_PARAM;
+            using window_updater_t = WindowUpdater TEMPLATE_PARAM;
+            using scheduler_t = H2Scheduler TEMPLATE_PARAM;
+            using settings_t = typename h2request_t::settings_t;
 
             static void init(h2request_t& ctx) {
                 manager_t::init_streams(ctx);
             }
 
+            static void init(h2request_t& ctx, client_t& cli) {
+                init(ctx);
+                //peer may refuse streams over its limit before its SETTINGS is received
+                ctx.remote_settings[key(H2PredefinedSetting::max_concurrent_streams)] = h2_initial_max_concurrent_streams;
+                cli.exchanges.clear();
+                cli.done.clear();
+                cli.sending.clear();
+                cli.goaway_recved = false;
+            }
+
             static bool send_connection_preface(conn_t& conn, h1request_t& req, CancelContext* cancel = nullptr) {
                 WriteContext w;
                 w.ptr = h2_connection_preface;
@@ -628,13 +1032,13 @@ namespace socklib {
                 return writer_t::write_settings(conn, req, ctx, false, ctx.local_settings, cancel);
             }
 
-            static H2Err read_a_frame(conn_t& conn, std::shared_ptr<frame_t>& frame, readctx_t& read, CancelContext* cancel = nullptr) {
+            static H2Err read_a_frame(conn_t& conn, frame_t*& frame, readctx_t& read, CancelContext* cancel = nullptr) {
                 auto err = reader_t::read(conn, frame, read, cancel);
                 if (!err) {
                     writer_t::write_goaway(conn, read.req, read.ctx, read.req.streamid, (std::uint32_t)err.e, cancel);
                     return err;
                 }
-                err = accepter_t::accept(frame, read.ctx);
+                err = accepter_t::accept(*frame, read.ctx);
                 if (!err) {
                     writer_t::write_rst_stream(conn, read.req, read.ctx, (std::uint32_t)err.e, cancel);
                     return err;
@@ -653,14 +1057,19 @@ namespace socklib {
                         }
                     }
                 }
+                else if (auto p = frame->ping()) {
+                    if (p->is_set(H2Flag::ack)) {
+                        return writer_t::write_window_estimated(conn, read.req, read.ctx, *p, cancel);
+                    }
+                }
 
                 return true;
             }
 
-            static H2Err call_callback(conn_t& conn, std::shared_ptr<frame_t> frame, readctx_t read, CancelContext* cancel = nullptr) {
+            static H2Err call_callback(conn_t& conn, frame_t& frame, readctx_t& read, CancelContext* cancel = nullptr) {
                 if (read.ctx.user_callback) {
-                    auto err = read.ctx.user_callback(*frame, read.ctx.userctx, read.ctx, read.req);
-                    if (err) {
+                    auto err = read.ctx.user_callback(frame, read.ctx.userctx, read.ctx, read.req);
+                    if (!err) {
                         writer_t::write_goaway(conn, read.req, read.ctx, read.req.streamid, (std::uint32_t)err.e, cancel);
                         return err;
                     }
@@ -668,9 +1077,9 @@ namespace socklib {
                 return true;
             }
 
-            static bool handle_response(readctx_t& read, std::shared_ptr<frame_t>& frame, bool server) {
-                if (read.req.streamid == frame->get_id()) {
-                    if (auto header = frame->header()) {
+            static bool handle_response(readctx_t& read, frame_t& frame, bool server) {
+                if (read.req.streamid == frame.get_id()) {
+                    if (auto header = frame.header()) {
                         for (auto& h : header->header_map()) {
                             if (h.first == ":status") {
                                 commonlib2::Reader(h.second) >> read.req.statuscode;
@@ -680,15 +1089,17 @@ namespace socklib {
                             }
                         }
                         read.req.phase = server ? RequestPhase::request_recved : RequestPhase::response_recved;
-                        if (frame->is_set(H2Flag::end_stream)) {
+                        if (frame.is_set(H2Flag::end_stream)) {
                             return true;
                         }
                     }
-                    else if (auto data = frame->data()) {
-                        for (auto c : data->payload()) {
-                            read.req.responsebody.push_back(c);
+                    else if (auto data = frame.data()) {
+                        auto& payload = data->payload();
+                        if (!append_body(read.req, read.req.responsebody, payload.data(), payload.size())) {
+                            read.req.phase = RequestPhase::error;
+                            return true;
                         }
-                        if (frame->is_set(H2Flag::end_stream)) {
+                        if (frame.is_set(H2Flag::end_stream)) {
                             return true;
                         }
                     }
@@ -721,15 +1132,15 @@ namespace socklib {
                     else if (err) {
                         break;
                     }
-                    std::shared_ptr<frame_t> frame;
+                    frame_t* frame = nullptr;
                     err = read_a_frame(conn, frame, read, cancel);
                     if (!err) {
                         return err;
                     }
-                    if (handle_response(read, frame, false)) {
+                    if (handle_response(read, *frame, false)) {
                         break;
                     }
-                    err = call_callback(conn, frame, read, cancel);
+                    err = call_callback(conn, *frame, read, cancel);
                     if (!err) {
                         return err;
                     }
@@ -743,22 +1154,618 @@ namespace socklib {
                     return false;
                 }
                 while (true) {
-                    std::shared_ptr<frame_t> frame;
+                    frame_t* frame = nullptr;
                     auto err = read_a_frame(conn, frame, read, cancel);
                     if (!err) {
                         return err;
                     }
-                    if (handle_response(read, frame, false)) {
+                    if (auto d = frame->data()) {
+                        bool own = d->get_id() == read.req.streamid;
+                        err = writer_t::write_window_consumed(conn, read.req, read.ctx, *d, own, cancel);
+                        if (!err) {
+                            return err;
+                        }
+                    }
+                    if (handle_response(read, *frame, false)) {
                         break;
                     }
-                    err = call_callback(conn, frame, read, cancel);
+                    err = call_callback(conn, *frame, read, cancel);
                     if (!err) {
                         return err;
                     }
                 }
+                if (read.req.phase == RequestPhase::error) {
+                    writer_t::write_rst_stream(conn, read.req, read.ctx, (std::uint32_t)H2Error::cancel, cancel);
+                    manager_t::close_stream(read.ctx, read.req.streamid);
+                    return false;
+                }
                 read.req.phase = RequestPhase::body_recved;
+                manager_t::close_stream(read.ctx, read.req.streamid);
                 return true;
             }
+
+            //multiplexed requests
+            //any number of requests can be started on one connection with start_request()
+            //and their responses are received in the order they are completed with wait_response() and take_response()
+
+           private:
+            static void finish(client_t& cli, h1request_t& req, RequestPhase phase) {
+                req.phase = phase;
+                cli.done.push_back(req.streamid);
+            }
+
+            static bool in_flight(const h1request_t& req) {
+                return req.phase == RequestPhase::request_sending || req.phase == RequestPhase::request_sent ||
+                       req.phase == RequestPhase::response_recved;
+            }
+
+            static void fail_all(client_t& cli, std::int32_t after = 0) {
+                cli.sending.clear();
+                for (auto& ex : cli.exchanges) {
+                    if (ex.first > after && in_flight(ex.second)) {
+                        finish(cli, ex.second, RequestPhase::error);
+                    }
+                }
+            }
+
+            static void set_response(h1request_t& req, Header& header) {
+                if (req.phase == RequestPhase::response_recved) {
+                    //trailer
+                    for (auto& h : header) {
+                        req.response.emplace(h.first, h.second);
+                    }
+                    return;
+                }
+                req.response.clear();
+                for (auto& h : header) {
+                    if (h.first == ":status") {
+                        commonlib2::Reader(h.second) >> req.statuscode;
+                    }
+                    else {
+                        req.response.emplace(h.first, h.second);
+                    }
+                }
+                //wait final response if informational
+                if (req.statuscode >= 200) {
+                    req.phase = RequestPhase::response_recved;
+                }
+            }
+
+            static H2Err dispatch(conn_t& conn, frame_t& frame, readctx_t& read, client_t& cli, CancelContext* cancel) {
+                auto id = frame.get_id();
+                auto found = cli.exchanges.find(id);
+                bool active = found != cli.exchanges.end() && in_flight(found->second);
+                if (auto h = frame.header()) {
+                    if (active) {
+                        set_response(found->second, h->header_map());
+                        if (h->is_set(H2Flag::end_stream)) {
+                            finish(cli, found->second, RequestPhase::body_recved);
+                            manager_t::close_stream(read.ctx, id);
+                        }
+                    }
+                }
+                else if (auto d = frame.data()) {
+                    if (!active) {
+                        return writer_t::write_window_consumed(conn, read.req, read.ctx, *d, false, cancel);
+                    }
+                    auto& payload = d->payload();
+                    if (!append_body(found->second, found->second.responsebody, payload.data(), payload.size())) {
+                        finish(cli, found->second, RequestPhase::error);
+                        if (auto e = writer_t::write_rst_stream(conn, found->second, read.ctx, (std::uint32_t)H2Error::cancel, cancel); !e) {
+                            return e;
+                        }
+                        manager_t::close_stream(read.ctx, id);
+                        return writer_t::write_window_consumed(conn, read.req, read.ctx, *d, false, cancel);
+                    }
+                    if (d->is_set(H2Flag::end_stream)) {
+                        finish(cli, found->second, RequestPhase::body_recved);
+                        manager_t::close_stream(read.ctx, id);
+                    }
+                    return writer_t::write_window_consumed(conn, found->second, read.ctx, *d, true, cancel);
+                }
+                else if (frame.rst_stream()) {
+                    if (active) {
+                        finish(cli, found->second, RequestPhase::error);
+                    }
+                    manager_t::close_stream(read.ctx, id);
+                }
+                else if (auto p = frame.push_promise()) {
+                    //server push is not used
+                    h1request_t promised;
+                    promised.streamid = p->id();
+                    return writer_t::write_rst_stream(conn, promised, read.ctx, (std::uint32_t)H2Error::cancel, cancel);
+                }
+                else if (auto s = frame.settings()) {
+                    if (!s->is_set(H2Flag::ack)) {
+                        window_updater_t::resize(read.ctx, s);
+                        if (auto e = writer_t::write_settings(conn, read.req, read.ctx, true, settings_t(), cancel); !e) {
+                            return e;
+                        }
+                        return flush_pending(conn, read, cli, cancel);
+                    }
+                }
+                else if (auto p = frame.ping()) {
+                    if (!p->is_set(H2Flag::ack)) {
+                        return writer_t::write_ping(conn, read.req, read.ctx, true, cancel, p->payload());
+                    }
+                    return writer_t::write_window_estimated(conn, read.req, read.ctx, *p, cancel);
+                }
+                else if (frame.window_update()) {
+                    return flush_pending(conn, read, cli, cancel);
+                }
+                else if (auto g = frame.goaway()) {
+                    //streams after last stream id are not processed by server
+                    cli.goaway_recved = true;
+                    fail_all(cli, g->id());
+                }
+                return true;
+            }
+
+            static H2Err read_frame(conn_t& conn, readctx_t& read, client_t& cli, CancelContext* cancel) {
+                //pending request body is sent before waiting for frames
+                if (auto e = flush_pending(conn, read, cli, cancel); !e) {
+                    return e;
+                }
+                frame_t* frame = nullptr;
+                auto err = reader_t::read(conn, frame, read, cancel);
+                if (!err) {
+                    if (err != H2Error::internal) {
+                        writer_t::write_goaway(conn, read.req, read.ctx, 0, (std::uint32_t)err.e, cancel);
+                    }
+                    return err;
+                }
+                err = accepter_t::accept(*frame, read.ctx);
+                if (!err) {
+                    writer_t::write_goaway(conn, read.req, read.ctx, 0, (std::uint32_t)err.e, cancel);
+                    return err;
+                }
+                err = dispatch(conn, *frame, read, cli, cancel);
+                if (!err) {
+                    return err;
+                }
+                return call_callback(conn, *frame, read, cancel);
+            }
+
+            static size_t active_streams(client_t& cli) {
+                return cli.exchanges.size() - cli.done.size();
+            }
+
+           public:
+            //start req as new stream and keep it in cli until response is taken
+            //if SETTINGS_MAX_CONCURRENT_STREAMS is reached, frames are read until any stream is completed
+            static H2Err start_request(conn_t& conn, readctx_t& read, client_t& cli, h1request_t& req, CancelContext* cancel = nullptr) {
+                while (active_streams(cli) >= read.ctx.remote_settings[key(H2PredefinedSetting::max_concurrent_streams)]) {
+                    if (auto e = read_frame(conn, read, cli, cancel); !e) {
+                        fail_all(cli);
+                        return e;
+                    }
+                }
+                if (cli.goaway_recved) {
+                    read.ctx.err = H2Error::refused_stream;
+                    return read.ctx.err;
+                }
+                auto e = manager_t::make_new_stream(req.streamid, read.ctx);
+                if (!e) {
+                    return e;
+                }
+                scheduler_t::set_priority(read.ctx.streams[req.streamid], req.request);
+                bool closable = req.requestbody.size() == 0;
+                if (e = writer_t::write_header(conn, req, read.ctx, closable, cancel); !e) {
+                    return e;
+                }
+                auto id = req.streamid;
+                auto& ex = cli.exchanges[id];
+                ex = std::move(req);
+                ex.phase = RequestPhase::request_sent;
+                if (closable) {
+                    return true;
+                }
+                e = scheduler_t::start(conn, read.ctx, ex, cancel);
+                if (e) {
+                    return true;
+                }
+                if (e != H2Error::need_window_update) {
+                    cli.exchanges.erase(id);
+                    return e;
+                }
+                ex.phase = RequestPhase::request_sending;
+                cli.sending.push_back(id);
+                return true;
+            }
+
+            //send request body which was waiting for window or for its turn
+            static H2Err flush_pending(conn_t& conn, readctx_t& read, client_t& cli, CancelContext* cancel = nullptr) {
+                auto get = [&](std::int32_t id) -> h1request_t* {
+                    auto found = cli.exchanges.find(id);
+                    if (found == cli.exchanges.end() || found->second.phase != RequestPhase::request_sending) {
+                        return nullptr;
+                    }
+                    return &found->second;
+                };
+                auto done = [](std::int32_t, h1request_t& req) {
+                    req.phase = RequestPhase::request_sent;
+                };
+                return scheduler_t::schedule(conn, read.ctx, cli.sending, get, done, cancel);
+            }
+
+            //read frames until response of any stream is completed
+            //if connection is failed, all streams in flight are completed with RequestPhase::error
+            static H2Err wait_response(conn_t& conn, readctx_t& read, client_t& cli, CancelContext* cancel = nullptr) {
+                while (cli.done.empty()) {
+                    if (cli.exchanges.empty()) {
+                        return false;
+                    }
+                    if (auto e = read_frame(conn, read, cli, cancel); !e) {
+                        fail_all(cli);
+                        return e;
+                    }
+                }
+                return true;
+            }
+
+            //move completed response to req
+            static bool take_response(client_t& cli, h1request_t& req) {
+                if (cli.done.empty()) {
+                    return false;
+                }
+                auto found = cli.exchanges.find(cli.done.front());
+                cli.done.pop_front();
+                req = std::move(found->second);
+                cli.exchanges.erase(found);
+                return true;
+            }
+        };
+
+
+        H2TYPE_PARAMS
+        struct Http2ServerContext {
+            using h1request_t = RequestContext<String, Header, Body>;
+            //requests being received and responses waiting for flow control window
+            Map<std::int32_t, h1request_t> exchanges;
+            //streams whose request is completely received
+            std::deque<std::int32_t> ready;
+            //streams which have response data to send
+            std::deque<std::int32_t> sending;
+            bool preface_recved = false;
+            bool goaway_recved = false;
+            //advertised to client, and HEADERS over this count of exchanges is refused
+            std::uint32_t max_concurrent_streams = 256;
+        };
+
+        H2TYPE_PARAMS
+        struct Http2Server {
+            using h1request_t = RequestContext<String, Header, Body>;
+            using h2request_t = Http2RequestContext TEMPLATE_PARAM;
+            using server_t = Http2ServerContext TEMPLATE_PARAM;
+            using conn_t = std::shared_ptr<InetConn>;
+            using writer_t = H2FrmaeWriter TEMPLATE_PARAM;
+            using reader_t = Http2Reader TEMPLATE_PARAM;
+            using readctx_t = Http2ReadContext TEMPLATE_PARAM;
+            using frame_t = H2Frame TEMPLATE_PARAM;
+            using accepter_t = H2FrameAccepter TEMPLATE_PARAM;
+            using manager_t = StreamManager TEMPLATE_PARAM;
+            using window_updater_t = WindowUpdater TEMPLATE_PARAM;
+            using scheduler_t = H2Scheduler TEMPLATE_PARAM;
+            using settings_t = typename h2request_t::settings_t;
+
+            static void init(h2request_t& ctx, server_t& srv) {
+                manager_t::init_streams(ctx, true);
+                srv.exchanges.clear();
+                srv.ready.clear();
+                srv.sending.clear();
+                srv.preface_recved = false;
+                srv.goaway_recved = false;
+            }
+
+            static H2Err send_first_settings(conn_t& conn, h1request_t& req, h2request_t& ctx, server_t& srv, CancelContext* cancel = nullptr) {
+                //server must not send SETTINGS_ENABLE_PUSH
+                settings_t settings;
+                settings[key(H2PredefinedSetting::max_concurrent_streams)] = srv.max_concurrent_streams;
+                settings[key(H2PredefinedSetting::initial_window_size)] = ctx.local_settings[key(H2PredefinedSetting::initial_window_size)];
+                return writer_t::write_settings(conn, req, ctx, false, settings, cancel);
+            }
+
+            static bool recv_connection_preface(conn_t& conn, readctx_t& read, server_t& srv, CancelContext* cancel = nullptr) {
+                constexpr size_t len = 24;
+                while (read.readable() < len) {
+                    if (!reader_t::read_more(conn, read, cancel)) {
+                        return false;
+                    }
+                }
+                if (::memcmp(read.readptr(), h2_connection_preface, len) != 0) {
+                    read.ctx.err = H2Error::protocol;
+                    return false;
+                }
+                read.consume(len);
+                srv.preface_recved = true;
+                return true;
+            }
+
+           private:
+            static h1request_t stream_request(readctx_t& read, std::int32_t id) {
+                h1request_t req;
+                req.flag = read.req.flag;
+                req.error_cb = read.req.error_cb;
+                req.body_sink = read.req.body_sink;
+                req.sinkctx = read.req.sinkctx;
+                req.resolved_version = 2;
+                req.streamid = id;
+                return req;
+            }
+
+            static void set_request(h1request_t& req, Header& header) {
+                using commonlib2::split;
+                for (auto& h : header) {
+                    if (h.first == ":method") {
+                        req.method = h.second;
+                    }
+                    else if (h.first == ":path") {
+                        auto path = split(h.second, "?", 1);
+                        if (path.size() == 0) continue;
+                        req.parsed.path = path[0];
+                        if (path.size() == 2) {
+                            req.parsed.query = "?";
+                            req.parsed.query += path[1];
+                        }
+                    }
+                    else if (h.first == ":authority") {
+                        auto host = split(h.second, ":", 1);
+                        if (host.size() == 0) continue;
+                        req.parsed.host = host[0];
+                        if (host.size() == 2) {
+                            req.parsed.port = host[1];
+                        }
+                    }
+                    else if (h.first == ":scheme") {
+                        req.parsed.scheme = h.second;
+                    }
+                    else {
+                        req.request.emplace(h.first, h.second);
+                    }
+                }
+            }
+
+            //HEADERS on stream whose request is being received is trailer (RFC 7540 8.1)
+            //trailer must end stream and must not have pseudo header
+            template <class HeaderFrame>
+            static H2Err recv_trailer(h1request_t& req, HeaderFrame& h, readctx_t& read, server_t& srv) {
+                if (req.phase != RequestPhase::request_recving || !h.is_set(H2Flag::end_stream)) {
+                    read.ctx.err = H2Error::protocol;
+                    return read.ctx.err;
+                }
+                for (auto& f : h.header_map()) {
+                    if (f.first.size() && f.first[0] == ':') {
+                        read.ctx.err = H2Error::protocol;
+                        return read.ctx.err;
+                    }
+                }
+                for (auto& f : h.header_map()) {
+                    req.request.emplace(f.first, f.second);
+                }
+                req.phase = RequestPhase::body_recved;
+                srv.ready.push_back(req.streamid);
+                return true;
+            }
+
+            static void drop(server_t& srv, std::int32_t id) {
+                srv.exchanges.erase(id);
+                srv.ready.erase(std::remove(srv.ready.begin(), srv.ready.end(), id), srv.ready.end());
+                srv.sending.erase(std::remove(srv.sending.begin(), srv.sending.end(), id), srv.sending.end());
+            }
+
+            static H2Err handle_frame(conn_t& conn, frame_t& frame, readctx_t& read, server_t& srv, CancelContext* cancel) {
+                auto id = frame.get_id();
+                if (auto h = frame.header()) {
+                    if (auto found = srv.exchanges.find(id); found != srv.exchanges.end()) {
+                        return recv_trailer(found->second, *h, read, srv);
+                    }
+                    if (srv.exchanges.size() >= srv.max_concurrent_streams) {
+                        //over advertised SETTINGS_MAX_CONCURRENT_STREAMS (RFC 7540 5.1.2)
+                        auto refused = stream_request(read, id);
+                        if (auto e = writer_t::write_rst_stream(conn, refused, read.ctx, (std::uint32_t)H2Error::refused_stream, cancel); !e) {
+                            return e;
+                        }
+                        manager_t::close_stream(read.ctx, id);
+                        return true;
+                    }
+                    auto& req = srv.exchanges[id];
+                    req = stream_request(read, id);
+                    set_request(req, h->header_map());
+                    scheduler_t::set_priority(read.ctx.streams[id], req.request);
+                    req.phase = RequestPhase::request_recving;
+                    if (h->is_set(H2Flag::end_stream)) {
+                        req.phase = RequestPhase::body_recved;
+                        srv.ready.push_back(id);
+                    }
+                }
+                else if (auto d = frame.data()) {
+                    auto found = srv.exchanges.find(id);
+                    if (found == srv.exchanges.end() || found->second.phase != RequestPhase::request_recving) {
+                        return writer_t::write_window_consumed(conn, read.req, read.ctx, *d, false, cancel);
+                    }
+                    auto& payload = d->payload();
+                    if (!append_body(found->second, found->second.requestbody, payload.data(), payload.size())) {
+                        //request is dropped without being handed
+                        if (auto e = writer_t::write_rst_stream(conn, found->second, read.ctx, (std::uint32_t)H2Error::cancel, cancel); !e) {
+                            return e;
+                        }
+                        drop(srv, id);
+                        manager_t::close_stream(read.ctx, id);
+                        return writer_t::write_window_consumed(conn, read.req, read.ctx, *d, false, cancel);
+                    }
+                    if (d->is_set(H2Flag::end_stream)) {
+                        found->second.phase = RequestPhase::body_recved;
+                        srv.ready.push_back(id);
+                    }
+                    return writer_t::write_window_consumed(conn, found->second, read.ctx, *d, true, cancel);
+                }
+                else if (frame.rst_stream()) {
+                    drop(srv, id);
+                    manager_t::close_stream(read.ctx, id);
+                }
+                else if (auto s = frame.settings()) {
+                    if (!s->is_set(H2Flag::ack)) {
+                        window_updater_t::resize(read.ctx, s);
+                        if (auto e = writer_t::write_settings(conn, read.req, read.ctx, true, settings_t(), cancel); !e) {
+                            return e;
+                        }
+                        return flush_pending(conn, read, srv, cancel);
+                    }
+                }
+                else if (auto p = frame.ping()) {
+                    if (!p->is_set(H2Flag::ack)) {
+                        return writer_t::write_ping(conn, read.req, read.ctx, true, cancel, p->payload());
+                    }
+                    return writer_t::write_window_estimated(conn, read.req, read.ctx, *p, cancel);
+                }
+                else if (frame.window_update()) {
+                    return flush_pending(conn, read, srv, cancel);
+                }
+                else if (frame.goaway()) {
+                    srv.goaway_recved = true;
+                }
+                else if (frame.push_promise()) {
+                    read.ctx.err = H2Error::protocol;
+                    return read.ctx.err;
+                }
+                return true;
+            }
+
+           public:
+            static H2Err read_a_frame(conn_t& conn, frame_t*& frame, readctx_t& read, server_t& srv, CancelContext* cancel = nullptr) {
+                auto err = reader_t::read(conn, frame, read, cancel);
+                if (!err) {
+                    if (err != H2Error::internal) {
+                        writer_t::write_goaway(conn, read.req, read.ctx, (std::int32_t)read.ctx.max_stream, (std::uint32_t)err.e, cancel);
+                    }
+                    return err;
+                }
+                err = accepter_t::accept(*frame, read.ctx);
+                if (!err) {
+                    writer_t::write_goaway(conn, read.req, read.ctx, (std::int32_t)read.ctx.max_stream, (std::uint32_t)err.e, cancel);
+                    return err;
+                }
+                err = handle_frame(conn, *frame, read, srv, cancel);
+                if (!err && err != H2Error::internal) {
+                    writer_t::write_goaway(conn, read.req, read.ctx, (std::int32_t)read.ctx.max_stream, (std::uint32_t)err.e, cancel);
+                }
+                return err;
+            }
+
+            //read frames until request of any stream is completely received
+            //requests are handed in the order they are completed, not in the order of stream id
+            //deferred response data is sent h2_schedule_quantum bytes per call while requests are ready or frames are buffered,
+            //and as much as flow control allows before waiting for frames
+            static H2Err request(conn_t& conn, readctx_t& read, server_t& srv, CancelContext* cancel = nullptr) {
+                if (!srv.preface_recved) {
+                    if (!recv_connection_preface(conn, read, srv, cancel)) {
+                        return false;
+                    }
+                }
+                size_t budget = h2_schedule_quantum;
+                if (srv.ready.size()) {
+                    if (auto e = flush_pending(conn, read, srv, cancel, budget); !e) {
+                        return e;
+                    }
+                }
+                while (srv.ready.empty()) {
+                    if (srv.goaway_recved && srv.exchanges.empty()) {
+                        read.req.phase = RequestPhase::closed;
+                        return false;
+                    }
+                    if (auto e = flush_pending(conn, read, srv, cancel, read.readable() ? budget : ~size_t(0)); !e) {
+                        return e;
+                    }
+                    frame_t* frame = nullptr;
+                    if (auto e = read_a_frame(conn, frame, read, srv, cancel); !e) {
+                        return e;
+                    }
+                }
+                return true;
+            }
+
+            //move completely received request to req
+            static bool take_request(server_t& srv, h1request_t& req) {
+                if (srv.ready.empty()) {
+                    return false;
+                }
+                auto id = srv.ready.front();
+                srv.ready.pop_front();
+                auto found = srv.exchanges.find(id);
+                req = std::move(found->second);
+                srv.exchanges.erase(found);
+                return true;
+            }
+
+            //send response to req.streamid
+            //at most h2_schedule_quantum bytes of body is written here, and if body remains, H2Error::need_window_update is returned
+            //and req should be passed to defer() to send rest of body in turn with other streams
+            static H2Err response(conn_t& conn, readctx_t& read, h1request_t& req, CancelContext* cancel = nullptr) {
+                if (req.phase != RequestPhase::body_recved) {
+                    req.err = HttpError::invalid_phase;
+                    return false;
+                }
+                if (req.statuscode < 100 || req.statuscode > 599) {
+                    req.statuscode = 500;
+                }
+                bool closable = req.responsebody.size() == 0;
+                if (auto e = writer_t::write_header(conn, req, read.ctx, closable, cancel); !e) {
+                    return e;
+                }
+                if (!closable) {
+                    if (auto e = scheduler_t::start(conn, read.ctx, req, cancel); !e) {
+                        return e;
+                    }
+                }
+                req.phase = RequestPhase::idle;
+                manager_t::close_stream(read.ctx, req.streamid);
+                return true;
+            }
+
+            static void defer(server_t& srv, h1request_t& req) {
+                auto id = req.streamid;
+                srv.exchanges[id] = std::move(req);
+                srv.sending.push_back(id);
+            }
+
+            //send response data which was waiting for window or for its turn
+            static H2Err flush_pending(conn_t& conn, readctx_t& read, server_t& srv, CancelContext* cancel = nullptr,
+                                       size_t budget = ~size_t(0)) {
+                auto get = [&](std::int32_t id) -> h1request_t* {
+                    auto found = srv.exchanges.find(id);
+                    if (found == srv.exchanges.end()) {
+                        return nullptr;
+                    }
+                    return &found->second;
+                };
+                auto done = [&](std::int32_t id, h1request_t&) {
+                    srv.exchanges.erase(id);
+                    manager_t::close_stream(read.ctx, id);
+                };
+                return scheduler_t::schedule(conn, read.ctx, srv.sending, get, done, cancel, budget);
+            }
+
+            //read frames until all deferred response data is sent
+            //and write frames buffered in read.ctx
+            static H2Err flush(conn_t& conn, readctx_t& read, server_t& srv, CancelContext* cancel = nullptr) {
+                while (srv.sending.size()) {
+                    if (auto e = flush_pending(conn, read, srv, cancel); !e) {
+                        return e;
+                    }
+                    if (srv.sending.empty()) {
+                        break;
+                    }
+                    frame_t* frame = nullptr;
+                    if (auto e = read_a_frame(conn, frame, read, srv, cancel); !e) {
+                        return e;
+                    }
+                }
+                return writer_t::flush(conn, read.req, read.ctx, cancel);
+            }
+
+            static H2Err shutdown(conn_t& conn, readctx_t& read, CancelContext* cancel = nullptr) {
+                return writer_t::write_goaway(conn, read.req, read.ctx, (std::int32_t)read.ctx.max_stream, 0, cancel);
+            }
         };
 
 #undef H2TYPE_PARAMS
@@ -9,6 +9,8 @@
 #include "hpack.h"
 #include "http_base.h"
 #include <net_helper.h>
+#include <tuple>
+#include <chrono>
 
 namespace socklib {
     namespace v2 {
@@ -132,6 +134,31 @@ namespace socklib {
         };
 
         constexpr auto h2_connection_preface = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+
+        //DATA frame smaller than this is not sent unless it is the rest of body
+        constexpr size_t h2_min_data_window = 4096;
+
+        //streams opened by client before peer's SETTINGS arrives
+        //RFC7540 recommends SETTINGS_MAX_CONCURRENT_STREAMS not to be smaller than this
+        constexpr std::uint32_t h2_initial_max_concurrent_streams = 100;
+
+        //consumed receive window is given back to peer when it exceeds 1/h2_window_update_divisor of receive window
+        constexpr std::int64_t h2_window_update_divisor = 4;
+
+        //receive window is not grown over this by bandwidth-delay product estimation
+        constexpr std::int64_t h2_max_receive_window = 16 * 1024 * 1024;
+
+        //buffered frames are written when buffer exceeds this
+        constexpr size_t h2_output_buffer_size = 16384;
+
+        //DATA sent by one stream in its turn while other streams are waiting to send
+        constexpr size_t h2_schedule_quantum = 65536;
+
+        //default urgency of RFC 9218 priority (0 is the most urgent and 7 is the least)
+        constexpr std::uint8_t h2_default_urgency = 3;
+
+        //payload of PING sent to measure round trip time
+        constexpr std::uint8_t h2_bdp_ping_payload[8] = {'s', 'o', 'c', 'k', 'b', 'd', 'p', 0};
         /*
         H2TYPE_PARAMS
 #ifdef COMMONLIB2_HAS_CONCEPTS
@@ -148,11 +175,37 @@ namespace socklib {
             std::int64_t local_window = 0;
             std::int64_t remote_window = 0;
             H2StreamState state = H2StreamState::idle;
-            H2Weight weight;
+            //default weight is 16 (RFC7540 5.3.5)
+            H2Weight weight{0, 15};
             std::uint32_t errorcode = 0;
 
             //for data frame
             size_t data_progress = 0;
+
+            //RFC 9218 priority of outbound DATA (u=3, i=?0 if Priority header is absent)
+            //streams of smaller urgency are sent first
+            //incremental streams share bandwidth by RFC7540 weight, and others are sent one after another
+            std::uint8_t urgency = h2_default_urgency;
+            bool incremental = false;
+            //virtual finish time of weighted fair queueing (see H2Scheduler)
+            std::uint64_t vtime = 0;
+
+            //received DATA not given back to peer by WINDOW_UPDATE yet
+            std::int64_t window_consumed = 0;
+        };
+
+        //bandwidth-delay product estimation of receiving side
+        //DATA received while PING is in flight is a sample of bytes peer can send in one round trip
+        struct H2WindowEstimator {
+            //receive window of connection given to peer (initial connection window is always 65535)
+            std::int64_t conn_window = 65535;
+            bool adaptive = true;
+            bool ping_inflight = false;
+            std::int64_t sample = 0;
+            std::chrono::steady_clock::time_point ping_sent;
+            std::chrono::steady_clock::duration rtt{};
+            //max bandwidth (bytes per microsecond) ever sampled
+            double bandwidth = 0;
         };
 
         H2TYPE_PARAMS
@@ -177,6 +230,11 @@ namespace socklib {
             streams_t streams;
             std::uint64_t max_stream = 0;
             bool server = false;
+            H2WindowEstimator estimator;
+            //virtual time of stream which sent DATA last
+            std::uint64_t vclock = 0;
+            //frames waiting to be written by H2Writer::flush
+            String outbuf;
 
             H2Err (*user_callback)(frame_t&, void*, const Http2RequestContext&, const RequestContext<String, Header, Body>&);
             void* userctx = nullptr;
@@ -244,6 +302,12 @@ namespace socklib {
                 flag |= f;
             }
 
+            //clear members so that frame object can be reused for next frame of same type
+            virtual void reset() {
+                flag = H2Flag::none;
+                streamid = 0;
+            }
+
             virtual H2Err parse(rawframe_t& v, h2request_t&) {
                 type = (H2FType)v.type;
                 flag = (H2Flag)v.flag;
@@ -272,12 +336,15 @@ namespace socklib {
             }
 
             static H2Err remove_padding(string_t& buf, int len, std::uint8_t& padding) {
+                if (len < 1) {
+                    return H2Error::frame_size;
+                }
                 std::uint8_t d = (std::uint8_t)buf[0];
                 buf.erase(0, 1);
-                if ((int)d > len) {
-                    return H2Error::frame_size;
+                if ((int)d > len - 1) {
+                    return H2Error::protocol;
                 }
-                buf.erase(len - d);
+                buf.erase(len - 1 - d);
                 padding = d;
                 return true;
             }
@@ -312,7 +379,7 @@ namespace socklib {
 
             template <class F>
             static H2Err write_continuous(int streamid, F&& write_header, writer_t& se, std::uint32_t fsize,
-                                          std::string& hpacked, H2Flag flag, H2Flag flagcpy, std::uint8_t& padding, std::uint8_t plus) {
+                                          std::string& hpacked, H2Flag& flag, H2Flag flagcpy, std::uint8_t& padding, std::uint8_t plus) {
                 size_t idx = 0;
                 if (!any(flag & H2Flag::padded)) {
                     padding = 0;
@@ -334,7 +401,7 @@ namespace socklib {
                     size_t idx = fsize - (padding + plus);
                     while (hpacked.size() - idx) {
                         if (hpacked.size() - idx <= fsize) {
-                            view = std::string_view(hpacked.data() + idx, hpacked.size());
+                            view = std::string_view(hpacked.data() + idx, hpacked.size() - idx);
                             idx = hpacked.size();
                             H2Frame::serialize_impl(view.size(), streamid, H2FType::continuation, H2Flag::end_headers, se);
                             se.write(view);
@@ -374,54 +441,135 @@ namespace socklib {
             using h1request_t = RequestContext<string_t, header_t, body_t>;
             h1request_t& req;
             h2request_t& ctx;
+            //received data is between rpos and filled, and rawdata after filled is spare space for next read
+            //rawdata is not shrunk so that the spare space is zero filled by resize only when rawdata grows
             string_t rawdata;
+            size_t rpos = 0;
+            size_t filled = 0;
+            //received frames are decoded into these objects and reused for next frame of same type
+            //so frame returned by Http2Reader::read is valid until next read
+            std::tuple<H2DataFrame TEMPLATE_PARAM, H2HeaderFrame TEMPLATE_PARAM, H2PriorityFrame TEMPLATE_PARAM,
+                       H2RstStreamFrame TEMPLATE_PARAM, H2SettingsFrame TEMPLATE_PARAM, H2PushPromiseFrame TEMPLATE_PARAM,
+                       H2PingFrame TEMPLATE_PARAM, H2GoAwayFrame TEMPLATE_PARAM, H2WindowUpdateFrame TEMPLATE_PARAM>
+                frames;
+            rawframe_t rawframe;
 
             Http2ReadContext(h1request_t & r, h2request_t & c)
                 : req(r), ctx(c) {}
 
+            size_t readable() const {
+                return filled - rpos;
+            }
+
+            const char* readptr() const {
+                return rawdata.data() + rpos;
+            }
+
+            void consume(size_t size) {
+                rpos += size;
+                if (rpos >= filled) {
+                    rpos = 0;
+                    filled = 0;
+                }
+            }
+
+            //replace unread data with data
+            void set_data(string_t data) {
+                rawdata = std::move(data);
+                rpos = 0;
+                filled = rawdata.size();
+            }
+
             virtual void on_error(std::int64_t errcode, CancelContext * cancel, const char* msg) override {
                 errorhandle_t::on_error(req, errcode, cancel, msg);
             }
 
             virtual void append(const char* ptr, size_t size) override {
-                rawdata.append(ptr, size);
+                size_t cap = 0;
+                ::memcpy(reserve(size, cap), ptr, size);
+                filled += size;
+            }
+
+            virtual char* reserve(size_t hint, size_t & cap) override {
+                compact();
+                if (rawdata.size() < filled + hint) {
+                    rawdata.resize(filled + hint);
+                }
+                cap = rawdata.size() - filled;
+                return rawdata.data() + filled;
+            }
+
+            virtual void commit(size_t size) override {
+                filled += size;
+            }
+
+           private:
+            //move unread data to front only when consumed data is not less than it
+            //so that each byte is moved at most once on average
+            void compact() {
+                if (rpos && rpos >= readable()) {
+                    ::memmove(rawdata.data(), rawdata.data() + rpos, readable());
+                    filled -= rpos;
+                    rpos = 0;
+                }
             }
         };
 
+        DEC_FRAME(H2Writer);
+
         DEF_H2TYPE(Http2Reader) {
             USING_H2FRAME;
             using h2readcontext_t = Http2ReadContext<String, Map, Header, Body, Table>;
+            //read from conn and append to read.rawdata
+            //returns false if failed or connection is closed by peer
+            //buffered frames are flushed before blocking on read
+            static bool read_more(std::shared_ptr<InetConn> & conn, h2readcontext_t & read, CancelContext * cancel = nullptr) {
+                if (!H2Writer TEMPLATE_PARAM::flush(conn, read.req, read.ctx, cancel)) {
+                    return false;
+                }
+                auto prev = read.readable();
+                if (!conn->read(read, cancel)) {
+                    return false;
+                }
+                return read.readable() != prev;
+            }
+
             static H2Err read_a_frame(std::shared_ptr<InetConn> & conn, h2readcontext_t & read, rawframe_t & frame, CancelContext* cancel = nullptr) {
                 if (!conn) return false;
-                commonlib2::Reader<string_t&> r(read.rawdata);
-                if (!read.rawdata.size()) {
-                    if (!conn->read(read, cancel)) {
+                while (read.readable() < 9) {
+                    if (!read_more(conn, read, cancel)) {
                         return false;
                     }
                 }
-                commonlib2::HTTP2Frame<string_t> f;
-                f.maxlen = read.ctx.local_settings[key(H2PredefinedSetting::max_frame_size)];
-                for (;;) {
-                    r.readwhile(commonlib2::http2frame_reader, frame);
-                    if (frame.continues) {
-                        if (!conn->read(read, cancel)) {
-                            return false;
-                        }
-                        continue;
-                    }
-                    if (!frame.succeed) {
-                        return H2Error::protocol;
+                auto head = reinterpret_cast<const unsigned char*>(read.readptr());
+                size_t len = (size_t(head[0]) << 16) | (size_t(head[1]) << 8) | size_t(head[2]);
+                if (len > read.ctx.local_settings[key(H2PredefinedSetting::max_frame_size)]) {
+                    return H2Error::frame_size;
+                }
+                frame.len = (int)len;
+                frame.type = head[3];
+                frame.flag = head[4];
+                //reserved bit must be ignored
+                frame.id = (int)(((std::uint32_t(head[5]) & 0x7f) << 24) | (std::uint32_t(head[6]) << 16) |
+                                 (std::uint32_t(head[7]) << 8) | std::uint32_t(head[8]));
+                while (read.readable() < 9 + len) {
+                    if (!read_more(conn, read, cancel)) {
+                        return false;
                     }
-                    break;
                 }
-                read.rawdata.erase(0, 9 + frame.buf.size());
+                frame.buf.resize(len);
+                ::memcpy(frame.buf.data(), read.readptr() + 9, len);
+                frame.succeed = true;
+                read.consume(9 + len);
                 return true;
             }
 
             template <class Frame>
-            static H2Err get_frame(rawframe_t & frame, std::shared_ptr<H2FRAME> & res, h2readcontext_t & read) {
-                res = std::make_shared<Frame>();
-                return res->parse(frame, read.ctx);
+            static H2Err get_frame(rawframe_t & frame, H2FRAME * &res, h2readcontext_t & read) {
+                auto& f = std::get<Frame>(read.frames);
+                f.Frame::reset();
+                res = &f;
+                return f.Frame::parse(frame, read.ctx);
             }
 
             static H2Err read_continuous(rawframe_t & frame, std::shared_ptr<InetConn> & conn, h2readcontext_t & ctx, CancelContext* cancel = nullptr) {
@@ -446,7 +594,7 @@ namespace socklib {
                 return true;
             }
 
-            static H2Err make_frame(std::shared_ptr<H2FRAME> & res, rawframe_t & frame, std::shared_ptr<InetConn> & conn, h2readcontext_t & ctx, CancelContext* cancel = nullptr) {
+            static H2Err make_frame(H2FRAME * &res, rawframe_t & frame, std::shared_ptr<InetConn> & conn, h2readcontext_t & ctx, CancelContext* cancel = nullptr) {
 #define F(TYPE) TYPE TEMPLATE_PARAM
                 switch (frame.type) {
                     case 0:
@@ -481,32 +629,125 @@ namespace socklib {
 #undef F
             }
 
-            static H2Err read(std::shared_ptr<InetConn> & conn, std::shared_ptr<H2FRAME> & res, h2readcontext_t & ctx, CancelContext* cancel = nullptr) {
-                rawframe_t frame;
-                if (auto e = read_a_frame(conn, ctx, frame, cancel); !e) {
-                    return e;
-                }
-                if (auto e = make_frame(res, frame, conn, ctx, cancel); !e) {
-                    ctx.ctx.err = e;
-                    return e;
+            //res points to frame in ctx.frames
+            static H2Err read(std::shared_ptr<InetConn> & conn, H2FRAME * &res, h2readcontext_t & ctx, CancelContext* cancel = nullptr) {
+                while (true) {
+                    auto& frame = ctx.rawframe;
+                    if (auto e = read_a_frame(conn, ctx, frame, cancel); !e) {
+                        return e;
+                    }
+                    if (auto e = make_frame(res, frame, conn, ctx, cancel); !e) {
+                        //frame of unknown type must be ignored (RFC 7540 section 4.1)
+                        if (e == H2Error::unimplemented) {
+                            continue;
+                        }
+                        ctx.ctx.err = e;
+                        return e;
+                    }
+                    return true;
                 }
-                return true;
             }
         };
 
         DEF_FRAME(H2Writer) {
             USING_H2FRAME;
             using h1request_t = RequestContext<string_t, header_t, body_t>;
+            //frame is appended to ctx.outbuf and written when it exceeds h2_output_buffer_size
+            //so that small frames written in a row are sent by one write
             static H2Err write(std::shared_ptr<InetConn> & conn, H2FRAME & frame, h1request_t & req, h2request_t & ctx, CancelContext * cancel) {
                 if (!conn) return false;
                 writer_t w;
-                if (auto e = frame.serialize(ctx.remote_settings[key(H2PredefinedSetting::max_frame_size)], w, ctx); !e) {
+                std::swap(w.get(), ctx.outbuf);
+                auto prev = w.get().size();
+                auto e = frame.serialize(ctx.remote_settings[key(H2PredefinedSetting::max_frame_size)], w, ctx);
+                if (!e) {
+                    w.get().resize(prev);
+                }
+                std::swap(w.get(), ctx.outbuf);
+                if (!e) {
                     return e;
                 }
+                if (ctx.outbuf.size() >= h2_output_buffer_size) {
+                    return flush(conn, req, ctx, cancel);
+                }
+                return true;
+            }
+
+            //write frames buffered by write
+            static H2Err flush(std::shared_ptr<InetConn> & conn, h1request_t & req, h2request_t & ctx, CancelContext * cancel) {
+                if (!ctx.outbuf.size()) {
+                    return true;
+                }
+                if (!conn) return false;
                 WriteContext c;
-                c.ptr = w.get().data();
-                c.bufsize = w.get().size();
-                if (!errorhandle_t::write_to_conn(conn, c, req, cancel)) {
+                c.ptr = ctx.outbuf.data();
+                c.bufsize = ctx.outbuf.size();
+                auto res = errorhandle_t::write_to_conn(conn, c, req, cancel);
+                ctx.outbuf.clear();
+                if (!res) {
+                    ctx.err = H2Error::internal;
+                    return ctx.err;
+                }
+                return true;
+            }
+
+            //write payload as DATA frames of frame's id and flags without copying payload
+            //only frame headers (and padding) are serialized and payload is written by one gathered write
+            //frames buffered in ctx.outbuf are written first in same write
+            //payload is split by peer's SETTINGS_MAX_FRAME_SIZE like H2DataFrame::serialize
+            static H2Err write_data(std::shared_ptr<InetConn> & conn, H2DataFrame TEMPLATE_PARAM & frame, std::string_view payload,
+                                    h1request_t & req, h2request_t & ctx, CancelContext * cancel) {
+                if (!conn) return false;
+                static const char zeros[256] = {0};
+                size_t fsize = ctx.remote_settings[key(H2PredefinedSetting::max_frame_size)];
+                bool padded = frame.is_set(H2Flag::padded);
+                std::uint8_t padding = padded ? frame.padlen() : 0;
+                size_t padoct = padded ? padding + 1 : 0;
+                if (fsize <= padoct) {
+                    ctx.err = H2Error::frame_size;
+                    return ctx.err;
+                }
+                H2Flag base = H2Flag::none;
+                if (frame.is_set(H2Flag::end_stream)) {
+                    base |= H2Flag::end_stream;
+                }
+                size_t first = payload.size() < fsize - padoct ? payload.size() : fsize - padoct;
+                size_t count = 1 + (payload.size() - first + fsize - 1) / fsize;
+                //headers must not be reallocated after their pointers are added to w
+                writer_t heads;
+                heads.get().reserve(count * 9 + 1);
+                GatherWriteContext w;
+                if (ctx.outbuf.size()) {
+                    w.add(ctx.outbuf.data(), ctx.outbuf.size());
+                }
+                size_t idx = 0;
+                do {
+                    size_t pad = idx == 0 ? padoct : 0;
+                    size_t willsize = payload.size() - idx;
+                    if (willsize > fsize - pad) {
+                        willsize = fsize - pad;
+                    }
+                    H2Flag flag = pad ? H2Flag::padded : H2Flag::none;
+                    if (idx + willsize == payload.size()) {
+                        flag |= base;
+                    }
+                    auto offset = heads.get().size();
+                    if (auto e = H2FRAME::serialize_impl((std::uint32_t)(willsize + pad), frame.get_id(), H2FType::data, flag, heads); !e) {
+                        return e;
+                    }
+                    if (pad) {
+                        heads.write(padding);
+                    }
+                    w.add(heads.get().data() + offset, heads.get().size() - offset);
+                    w.add(payload.data() + idx, willsize);
+                    if (pad) {
+                        w.add(zeros, padding);
+                    }
+                    idx += willsize;
+                } while (idx < payload.size());
+                auto res = errorhandle_t::write_to_conn(conn, w, req, cancel);
+                ctx.outbuf.clear();
+                if (!res) {
                     ctx.err = H2Error::internal;
                     return ctx.err;
                 }
@@ -536,6 +777,12 @@ namespace socklib {
                 padding = pad;
             }
 
+            void reset() override {
+                H2FRAME::reset();
+                data_.clear();
+                padding = 0;
+            }
+
             H2Err parse(rawframe_t & v, h2request_t & t) override {
                 H2FRAME::parse(v, t);
                 if (any(this->flag & H2Flag::padded)) {
@@ -544,34 +791,51 @@ namespace socklib {
                         return t.err;
                     }
                 }
-                data_ = std::move(v.buf);
+                //v.buf takes old buffer so that it is reused for next frame
+                data_.swap(v.buf);
                 return true;
             }
 
+            //payload larger than fsize (peer's SETTINGS_MAX_FRAME_SIZE) is split into multiple frames
+            //padding is added to first frame and END_STREAM is set only on last frame
             H2Err serialize(std::uint32_t fsize, writer_t & se, h2request_t & t) override {
-                size_t idx = 0;
-                unsigned char plus = 0;
                 H2Flag flagcpy = this->flag;
-                this->flag &= ~H2Flag::end_stream;
+                size_t plus = 0;
                 if (!any(this->flag & H2Flag::padded)) {
                     padding = 0;
                 }
                 else {
                     plus = 1;
                 }
-                size_t willsize = fsize - padding - plus, padoct = padding + plus;
-                if (willsize > t.local_settings[key(H2PredefinedSetting::max_frame_size)]) {
+                if (fsize <= padding + plus) {
                     t.err = H2Error::frame_size;
                     return t.err;
                 }
-                H2FRAME::serialize((int)willsize, se, t);
-                if (any(this->flag & H2Flag::padded)) {
-                    se.write(padding);
-                }
-                se.write_byte(data_);
-                for (auto i = 0; i < padding; i++) {
-                    se.write('\0');
-                }
+                size_t idx = 0;
+                do {
+                    size_t padoct = idx == 0 ? padding + plus : 0;
+                    size_t willsize = data_.size() - idx;
+                    if (willsize > fsize - padoct) {
+                        willsize = fsize - padoct;
+                    }
+                    this->flag = flagcpy & ~(H2Flag::end_stream | H2Flag::padded);
+                    if (padoct) {
+                        this->flag |= H2Flag::padded;
+                    }
+                    if (idx + willsize == data_.size()) {
+                        this->flag |= flagcpy & H2Flag::end_stream;
+                    }
+                    H2FRAME::serialize((std::uint32_t)(willsize + padoct), se, t);
+                    if (padoct) {
+                        se.write(padding);
+                    }
+                    se.write_byte(data_.data() + idx, willsize);
+                    for (auto i = 0; padoct && i < padding; i++) {
+                        se.write('\0');
+                    }
+                    idx += willsize;
+                } while (idx < data_.size());
+                this->flag = flagcpy;
                 return true;
             }
 
@@ -597,7 +861,7 @@ namespace socklib {
             bool get_weight(H2Weight & w) const {
                 if (!any(this->flag & H2Flag::priority)) return false;
                 w.exclusive = weight.exclusive;
-                w.depends_id = weight.depends;
+                w.depends_id = weight.depends_id;
                 w.weight = weight.weight;
                 return true;
             }
@@ -614,6 +878,13 @@ namespace socklib {
                 padding = pad;
             }
 
+            void reset() override {
+                H2FRAME::reset();
+                header_.clear();
+                weight = H2Weight{};
+                padding = 0;
+            }
+
             H2Err parse(rawframe_t & v, h2request_t & t) override {
                 H2FRAME::parse(v, t);
                 if (any(this->flag & H2Flag::padded)) {
@@ -622,7 +893,7 @@ namespace socklib {
                     }
                 }
                 if (any(this->flag & H2Flag::priority)) {
-                    if (auto e = H2FRAME::read_depends(this->weight, v.buf)) {
+                    if (auto e = H2FRAME::read_depends(this->weight, v.buf); !e) {
                         return e;
                     }
                 }
@@ -690,7 +961,7 @@ namespace socklib {
            public:
             void get_weight(H2Weight & w) const {
                 w.exclusive = weight.exclusive;
-                w.depends_id = weight.depends;
+                w.depends_id = weight.depends_id;
                 w.weight = weight.weight;
             }
 
@@ -698,6 +969,11 @@ namespace socklib {
                 weight = w;
             }
 
+            void reset() override {
+                H2FRAME::reset();
+                weight = H2Weight{};
+            }
+
             H2Err parse(rawframe_t & v, h2request_t & t) override {
                 H2FRAME::parse(v, t);
                 if (auto e = H2FRAME::read_depends(weight, v.buf); !e) {
@@ -735,6 +1011,11 @@ namespace socklib {
                 errcode = code;
             }
 
+            void reset() override {
+                H2FRAME::reset();
+                errcode = 0;
+            }
+
             H2Err parse(rawframe_t & v, h2request_t & t) override {
                 H2FRAME::parse(v, t);
                 if (v.len != 4) {
@@ -750,7 +1031,7 @@ namespace socklib {
             }
 
             H2Err serialize(std::uint32_t fsize, writer_t & se, h2request_t & t) override {
-                if (auto e = H2FRAME::serialize(4, se, t)) {
+                if (auto e = H2FRAME::serialize(4, se, t); !e) {
                     t.err = e;
                     return e;
                 }
@@ -780,6 +1061,12 @@ namespace socklib {
                 return oldset;
             }
 
+            void reset() override {
+                H2FRAME::reset();
+                oldset.clear();
+                newset.clear();
+            }
+
             H2Err parse(rawframe_t & v, h2request_t & t) override {
                 H2FRAME::parse(v, t);
                 if (this->streamid != 0) {
@@ -808,7 +1095,7 @@ namespace socklib {
                     }
                     newset[key] = value;
                     auto& tmp = t.remote_settings[key];
-                    oldset[key] = value;
+                    oldset[key] = tmp;
                     tmp = value;
                 }
                 return true;
@@ -860,6 +1147,17 @@ namespace socklib {
                 return promiseid;
             }
 
+            void set_padding(std::uint8_t pad) {
+                padding = pad;
+            }
+
+            void reset() override {
+                H2FRAME::reset();
+                promiseid = 0;
+                header_.clear();
+                padding = 0;
+            }
+
             H2Err parse(rawframe_t & v, h2request_t & t) override {
                 if (!t.remote_settings[(unsigned short)H2PredefinedSetting::enable_push]) {
                     t.err = H2Error::protocol;
@@ -945,6 +1243,11 @@ namespace socklib {
                 return data_;
             }
 
+            void reset() override {
+                H2FRAME::reset();
+                ::memset(data_, 0, sizeof(data_));
+            }
+
             H2Err parse(rawframe_t & v, h2request_t & t) override {
                 H2FRAME::parse(v, t);
                 if (v.len != 8) {
@@ -1001,6 +1304,13 @@ namespace socklib {
                 return additionaldata;
             }
 
+            void reset() override {
+                H2FRAME::reset();
+                lastid = 0;
+                errcode = 0;
+                additionaldata.clear();
+            }
+
             H2Err parse(rawframe_t & v, h2request_t & t) override {
                 H2FRAME::parse(v, t);
                 reader_t se(v.buf);
@@ -1008,16 +1318,16 @@ namespace socklib {
                     t.err = H2Error::protocol;
                     return t.err;
                 }
-                if (se.read_ntoh(lastid)) {
-                    t.err = H2Error::internal;
+                if (!se.read_ntoh(lastid)) {
+                    t.err = H2Error::frame_size;
                     return t.err;
                 }
                 if (lastid < 0) {
                     t.err = H2Error::protocol;
                     return t.err;
                 }
-                if (se.read_ntoh(errcode)) {
-                    t.err = H2Error::internal;
+                if (!se.read_ntoh(errcode)) {
+                    t.err = H2Error::frame_size;
                     return t.err;
                 }
                 v.buf.erase(0, 8);
@@ -1029,7 +1339,7 @@ namespace socklib {
                 if (additionaldata.size() + 9 + 8 > fsize) {
                     return H2Error::frame_size;
                 }
-                if (auto e = H2FRAME::serialize((std::uint32_t)additionaldata.size() + 8, se, t)) {
+                if (auto e = H2FRAME::serialize((std::uint32_t)additionaldata.size() + 8, se, t); !e) {
                     t.err = e;
                     return e;
                 }
@@ -1063,6 +1373,11 @@ namespace socklib {
                 return true;
             }
 
+            void reset() override {
+                H2FRAME::reset();
+                value = 0;
+            }
+
             H2Err parse(rawframe_t & v, h2request_t & t) override {
                 H2FRAME::parse(v, t);
                 reader_t se(v.buf);
@@ -1086,7 +1401,7 @@ namespace socklib {
                     t.err = H2Error::protocol;
                     return t.err;
                 }
-                if (auto e = H2FRAME::serialize(4, se, t)) {
+                if (auto e = H2FRAME::serialize(4, se, t); !e) {
                     t.err = e;
                     return t.err;
                 }
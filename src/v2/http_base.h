@@ -181,6 +181,7 @@ namespace socklib {
             invalid_phase,
             invalid_header,
             invalid_status,
+            body_sink_failed,
         };
 
         enum class RequestFlag : std::uint8_t {
@@ -260,6 +261,14 @@ namespace socklib {
             header_t response = header_t();
             body_t responsebody = body_t();
 
+            //if set, received body (response body on client, request body on server) is passed to body_sink as it arrives
+            //instead of being stored in responsebody or requestbody
+            //receiving is blocked while body_sink runs, so slow sink slows peer down through TCP or HTTP/2 flow control
+            //if body_sink returns false, receiving is aborted with HttpError::body_sink_failed
+            using body_sink_t = bool (*)(const RequestContext& req, const char* data, size_t size, void* sinkctx);
+            body_sink_t body_sink = nullptr;
+            void* sinkctx = nullptr;
+
             //common params
             void (*error_cb)(std::uint64_t code, CancelContext* cancel, const char* msg) = nullptr;
             TCPError tcperr = TCPError::none;
@@ -272,6 +281,25 @@ namespace socklib {
             std::int32_t streamid = 0;
         };
 
+        //append received body data to body or pass it to req.body_sink
+        template <class String, class Header, class Body>
+        bool append_body(RequestContext<String, Header, Body>& req, Body& body, const char* data, size_t size) {
+            if (size == 0) {
+                return true;
+            }
+            if (req.body_sink) {
+                if (!req.body_sink(req, data, size, req.sinkctx)) {
+                    req.err = HttpError::body_sink_failed;
+                    return false;
+                }
+                return true;
+            }
+            auto nowsize = body.size();
+            body.resize(nowsize + size);
+            ::memcpy(&body[nowsize], data, size);
+            return true;
+        }
+
         template <class String>
         struct HttpAcceptContext {
             int http_version = 0;
@@ -448,29 +476,34 @@ namespace socklib {
                 return 1;
             }
 
-            template <class URL, class Property>
-            static bool open_connection(std::shared_ptr<InetConn>& conn,
-                                        URL& parsed, Property& prop, std::uint16_t port, int prev_version, CancelContext* cancel) {
-                TCPOpenContext<String> tcpopen;
-                if (prev_version != 0 && prop.http_version != prev_version) {
-                    tcpopen.forceopen = true;
-                }
-                switch (prop.http_version) {
+            //ALPN protocols (wire format) offered for http_version
+            static void select_alpn(int http_version, const char*& alpnstr, size_t& len) {
+                switch (http_version) {
                     case 1:
-                        tcpopen.alpnstr = "\x08http/1.1";
-                        tcpopen.len = 9;
+                        alpnstr = "\x08http/1.1";
+                        len = 9;
                         break;
                     case 2:
-                        tcpopen.alpnstr = "\x02h2";
-                        tcpopen.len = 3;
+                        alpnstr = "\x02h2";
+                        len = 3;
                         break;
                     case 3:
                         //http3 unimplemented
                     default:
-                        tcpopen.alpnstr = "\x02h2\x08http/1.1";
-                        tcpopen.len = 12;
+                        alpnstr = "\x02h2\x08http/1.1";
+                        len = 12;
                         break;
                 }
+            }
+
+            template <class URL, class Property>
+            static bool open_connection(std::shared_ptr<InetConn>& conn,
+                                        URL& parsed, Property& prop, std::uint16_t port, int prev_version, CancelContext* cancel) {
+                TCPOpenContext<String> tcpopen;
+                if (prev_version != 0 && prop.http_version != prev_version) {
+                    tcpopen.forceopen = true;
+                }
+                select_alpn(prop.http_version, tcpopen.alpnstr, tcpopen.len);
                 tcpopen.stat.type = ConnType::tcp_over_ssl;
                 if (parsed.scheme == "https" || parsed.scheme == "wss") {
                     tcpopen.stat.status = ConnStatus::secure;
@@ -549,7 +582,6 @@ namespace socklib {
                 if (req.parsed.port.size()) {
                     commonlib2::Reader(req.parsed.port) >> port;
                 }
-                std::shared_ptr<InetConn> tmpconn = conn;
                 auto res = open_connection(conn, req.parsed, req, port, prev_version, cancel);
                 if (!res) {
                     return false;
@@ -560,10 +592,34 @@ namespace socklib {
                 }
                 if (!verify_alpn(conn, req)) {
                     req.phase = RequestPhase::error;
-                    return true;
+                    return false;
                 }
                 req.phase = RequestPhase::open_direct;
-                conn = std::move(tmpconn);
+                return true;
+            }
+
+            //parse req.url and make key of its origin (scheme, host, port and offered ALPN)
+            //connections opened by open() for requests of same key are interchangeable
+            static bool origin_key(request_t& req, string_t& key,
+                                   const string_t& expect1 = "http", const string_t& expect2 = "https") {
+                if (!urlparser_t::parse_request(req, expect1, expect2)) {
+                    return false;
+                }
+                const char* alpnstr = nullptr;
+                size_t len = 0;
+                select_alpn(req.http_version, alpnstr, len);
+                key = req.parsed.scheme;
+                key += "://";
+                key += req.parsed.host;
+                key += ":";
+                if (req.parsed.port.size()) {
+                    key += req.parsed.port;
+                }
+                else {
+                    key += util_t::translate_to_service(req.parsed.scheme);
+                }
+                key += "/";
+                key.append(alpnstr, len);
                 return true;
             }
 
@@ -582,6 +638,20 @@ namespace socklib {
 
             static std::shared_ptr<InetConn> accept(HttpAcceptContext<String>& ctx, CancelContext* cancel = nullptr) {
                 ctx.tcp.service = util_t::translate_to_service(default_scheme(ctx.scheme));
+                if (ctx.scheme == HttpDefaultScheme::https || ctx.scheme == HttpDefaultScheme::wss) {
+                    ctx.tcp.stat.type = ConnType::tcp_over_ssl;
+                    ctx.tcp.stat.status |= ConnStatus::secure;
+                    if (!ctx.tcp.alpnstr) {
+                        if (ctx.http_version == 1 || ctx.scheme == HttpDefaultScheme::wss) {
+                            ctx.tcp.alpnstr = "\x08http/1.1";
+                            ctx.tcp.len = 9;
+                        }
+                        else {
+                            ctx.tcp.alpnstr = "\x02h2\x08http/1.1";
+                            ctx.tcp.len = 12;
+                        }
+                    }
+                }
                 auto accepted = TCP<String>::accept(ctx.tcp, cancel);
                 return accepted;
             }
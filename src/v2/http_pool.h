@@ -0,0 +1,208 @@
+/*
+    socklib - simple socket library
+    Copyright (c) 2021 on-keyday (https://github.com/on-keyday)
+    Released under the MIT license
+    https://opensource.org/licenses/mit-license.php
+*/
+
+#pragma once
+
+#include "http2.h"
+
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <deque>
+#include <vector>
+#include <memory>
+
+namespace socklib {
+    namespace v2 {
+
+        //HTTP/2 connection state which moves with pooled connection
+        //so that next user of connection continues its stream ids, HPACK tables and flow control windows
+        template <class String, class Header, class Body, template <class...> class Map, class Table>
+        struct HttpPooledH2Session {
+            Http2RequestContext<String, Map, Header, Body, Table> h2ctx;
+            Http2ClientContext<String, Map, Header, Body, Table> h2cli;
+            //received but not consumed data
+            String rawdata;
+        };
+
+        template <class String, class Header, class Body, template <class...> class Map, class Table>
+        struct HttpPooledConn {
+            std::shared_ptr<InetConn> conn;
+            //resolved http version of conn
+            int version = 0;
+            //set if version is 2
+            std::unique_ptr<HttpPooledH2Session<String, Header, Body, Map, Table>> h2;
+            //time when conn became idle
+            std::chrono::steady_clock::time_point since;
+        };
+
+        //HttpConnPool - keep-alive connections shared by ClientRequestProxy (see make_request(pool))
+        //connection is leased to one proxy for its origin (see HttpBase::origin_key)
+        //and returned when proxy moves to other origin or is destroyed
+        //member functions are thread safe, but settings must be set before pool is shared
+        template <class String, class Header, class Body, template <class...> class Map, class Table>
+        struct HttpConnPool {
+            using conn_t = HttpPooledConn<String, Header, Body, Map, Table>;
+            using session_t = HttpPooledH2Session<String, Header, Body, Map, Table>;
+            using clock_t = std::chrono::steady_clock;
+
+            //idle connection older than this is closed
+            std::chrono::milliseconds idle_timeout{90000};
+            //count of idle connections kept for each origin
+            size_t max_idle_per_origin = 4;
+            //count of idle connections kept for all origins
+            size_t max_idle = 64;
+            //count of connections (leased and idle) for each origin, or 0 for unlimited
+            //lease() waits for release() of other proxy while this is reached
+            size_t max_per_origin = 0;
+
+           private:
+            struct Origin {
+                //newest is back
+                std::deque<conn_t> idle;
+                size_t leased = 0;
+            };
+            Map<String, Origin> origins;
+            size_t idle_count = 0;
+            std::mutex lock;
+            std::condition_variable released;
+
+            //readability probe of idle connection
+            //idle HTTP/1.1 connection is readable only if peer closed it (or sent unexpected data), so it is not reusable
+            //idle HTTP/2 connection may receive frames like PING or SETTINGS, so it is alive unless peer closed it
+            static bool is_alive(conn_t& c) {
+                ConnStat stat;
+                c.conn->stat(stat);
+                if (!any(stat.status & ConnStatus::has_fd)) {
+                    return false;
+                }
+                auto res = wait_io_once(stat.net.sock, false, 0);
+                if (res == WaitResult::timeout) {
+                    return true;
+                }
+                if (res != WaitResult::ready || c.version != 2) {
+                    return false;
+                }
+                char peek = 0;
+                auto n = ::recv(stat.net.sock, &peek, 1, MSG_PEEK);
+                return n > 0 || (n < 0 && io_would_block());
+            }
+
+            //move idle connections over idle_timeout or max_idle into expired
+            //lock must be held
+            void expire(std::vector<conn_t>& expired) {
+                auto now = clock_t::now();
+                for (auto it = origins.begin(); it != origins.end();) {
+                    auto& idle = it->second.idle;
+                    while (idle.size() && now - idle.front().since > idle_timeout) {
+                        expired.push_back(std::move(idle.front()));
+                        idle.pop_front();
+                        idle_count--;
+                    }
+                    if (idle.empty() && !it->second.leased) {
+                        it = origins.erase(it);
+                        continue;
+                    }
+                    it++;
+                }
+                while (idle_count > max_idle) {
+                    Origin* oldest = nullptr;
+                    for (auto& o : origins) {
+                        if (o.second.idle.size() && (!oldest || o.second.idle.front().since < oldest->idle.front().since)) {
+                            oldest = &o.second;
+                        }
+                    }
+                    expired.push_back(std::move(oldest->idle.front()));
+                    oldest->idle.pop_front();
+                    idle_count--;
+                }
+            }
+
+           public:
+            //lease connection for origin key
+            //if out.conn is nullptr, caller should open new connection and pass it to release() later
+            //returns false if canceled while waiting for max_per_origin
+            bool lease(const String& key, conn_t& out, CancelContext* cancel = nullptr) {
+                //closed after lock is released
+                std::vector<conn_t> expired;
+                std::unique_lock<std::mutex> guard(lock);
+                while (true) {
+                    expire(expired);
+                    auto& origin = origins[key];
+                    while (origin.idle.size()) {
+                        auto c = std::move(origin.idle.back());
+                        origin.idle.pop_back();
+                        idle_count--;
+                        if (is_alive(c)) {
+                            origin.leased++;
+                            out = std::move(c);
+                            return true;
+                        }
+                        expired.push_back(std::move(c));
+                    }
+                    if (!max_per_origin || origin.leased < max_per_origin) {
+                        origin.leased++;
+                        out = conn_t{};
+                        return true;
+                    }
+                    if (cancel && cancel->on_cancel()) {
+                        return false;
+                    }
+                    released.wait_for(guard, std::chrono::milliseconds(io_wait_slice_msec));
+                }
+            }
+
+            //return lease of origin key
+            //c.conn is kept as idle connection unless it is nullptr
+            void release(const String& key, conn_t&& c) {
+                std::vector<conn_t> expired;
+                {
+                    std::lock_guard<std::mutex> guard(lock);
+                    auto& origin = origins[key];
+                    if (origin.leased) {
+                        origin.leased--;
+                    }
+                    if (c.conn) {
+                        c.since = clock_t::now();
+                        origin.idle.push_back(std::move(c));
+                        idle_count++;
+                        if (origin.idle.size() > max_idle_per_origin) {
+                            expired.push_back(std::move(origin.idle.front()));
+                            origin.idle.pop_front();
+                            idle_count--;
+                        }
+                    }
+                    expire(expired);
+                }
+                released.notify_all();
+            }
+
+            //close all idle connections
+            //returns count of closed connections
+            size_t close_idle() {
+                std::vector<conn_t> expired;
+                {
+                    std::lock_guard<std::mutex> guard(lock);
+                    for (auto& o : origins) {
+                        for (auto& c : o.second.idle) {
+                            expired.push_back(std::move(c));
+                        }
+                        o.second.idle.clear();
+                    }
+                    idle_count = 0;
+                    expire(expired);
+                }
+                return expired.size();
+            }
+
+            size_t idle_size() {
+                std::lock_guard<std::mutex> guard(lock);
+                return idle_count;
+            }
+        };
+    }  // namespace v2
+}  // namespace socklib
@@ -11,9 +11,18 @@
 #include "../common/cancel.h"
 #include <enumext.h>
 #include <memory>
+#include <vector>
+#ifdef _WIN32
+#include <io.h>
+#endif
 
 namespace socklib {
     namespace v2 {
+        struct IOVec {
+            const char* ptr = nullptr;
+            size_t size = 0;
+        };
+
         struct IWriteContext {
             virtual const char* bufptr() = 0;
             virtual size_t size() = 0;
@@ -22,6 +31,14 @@ namespace socklib {
             }
             virtual bool done() = 0;
             virtual void on_error(std::int64_t, CancelContext*, const char* msg) {}
+
+            //vectors returns buffers to write at once (scatter-gather I/O)
+            //if returns 0, bufptr()/size()/done() are used instead
+            //connection which doesn't support this may use bufptr()/size()/done()
+            virtual size_t vectors(const IOVec*& vec) {
+                vec = nullptr;
+                return 0;
+            }
         };
 
         struct WriteContext : IWriteContext {
@@ -54,6 +71,40 @@ namespace socklib {
             }
         };
 
+        //GatherWriteContext - write multiple buffers without concatenating them
+        struct GatherWriteContext : WriteContext {
+            std::vector<IOVec> vec;
+            size_t index = 0;
+
+            void add(const char* ptr, size_t size) {
+                if (!ptr || !size) return;
+                vec.push_back(IOVec{ptr, size});
+            }
+
+            void clear() {
+                vec.clear();
+                index = 0;
+            }
+
+            const char* bufptr() override {
+                return index < vec.size() ? vec[index].ptr : nullptr;
+            }
+
+            size_t size() override {
+                return index < vec.size() ? vec[index].size : 0;
+            }
+
+            bool done() override {
+                index++;
+                return index >= vec.size();
+            }
+
+            size_t vectors(const IOVec*& v) override {
+                v = vec.data();
+                return vec.size();
+            }
+        };
+
         struct IReadContext {
             virtual void append(const char* read, size_t size) = 0;
             virtual std::uint64_t flags() {
@@ -63,6 +114,15 @@ namespace socklib {
             virtual bool require() {
                 return false;
             }
+
+            //reserve returns writable span which has hint bytes (or more) to read data into directly
+            //if returns nullptr, connection reads into own buffer and calls append()
+            //after reading, commit() is called with size which is actually written (0 if failed)
+            virtual char* reserve(size_t hint, size_t& cap) {
+                cap = 0;
+                return nullptr;
+            }
+            virtual void commit(size_t size) {}
         };
 
         template <class Buf>
@@ -70,10 +130,30 @@ namespace socklib {
             using buffer_t = Buf;
             buffer_t buf;
             bool cancel_when_block = false;
+            size_t reserved = 0;
             void append(const char* read, size_t size) override {
                 buf.append(read, size);
             }
 
+            //buf is read into directly only if it can grow without zero filling
+            //otherwise connection reads into own buffer, since filling hint bytes on each read costs more than copying received data
+            char* reserve(size_t hint, size_t& cap) override {
+#ifdef __cpp_lib_string_resize_and_overwrite
+                if constexpr (requires { buf.resize_and_overwrite(hint, [](char*, size_t n) { return n; }); }) {
+                    reserved = buf.size();
+                    buf.resize_and_overwrite(reserved + hint, [](char*, size_t n) { return n; });
+                    cap = hint;
+                    return buf.data() + reserved;
+                }
+#endif
+                cap = 0;
+                return nullptr;
+            }
+
+            void commit(size_t size) override {
+                buf.resize(reserved + size);
+            }
+
             std::uint64_t flags() override {
                 return cancel_when_block ? 1 : 0;
             }
@@ -127,6 +207,7 @@ namespace socklib {
                     ::SSL* ssl = nullptr;
                     ::SSL_CTX* ssl_ctx = nullptr;
                     ::addrinfo* addrinfo = nullptr;
+                    SOCKET sock = (SOCKET)-1;
                 } net{0};
             };
 
@@ -155,6 +236,25 @@ namespace socklib {
             virtual ~IConn() {}
         };
 
+        constexpr size_t file_copy_size = 64 * 1024;
+
+        //read_file_at reads file fd from offset
+        //returns read bytes, 0 at end of file or -1 if failed
+        inline std::int64_t read_file_at(int fd, char* buf, size_t size, std::uint64_t offset) {
+#ifdef _WIN32
+            if (::_lseeki64(fd, (__int64)offset, SEEK_SET) < 0) {
+                return -1;
+            }
+            return ::_read(fd, buf, size < 0x7fffffff ? (unsigned int)size : 0x7fffffff);
+#else
+            while (true) {
+                auto res = ::pread(fd, buf, size, (::off_t)offset);
+                if (res < 0 && errno == EINTR) continue;
+                return res;
+            }
+#endif
+        }
+
         //InetConn - base of all internet connection
         struct InetConn : IConn {
            protected:
@@ -227,6 +327,25 @@ namespace socklib {
                 return true;
             }
 
+            //send_file sends size bytes of file fd from offset
+            //file data is read into buffer and sent by write(). StreamConn sends it without copying if possible
+            virtual bool send_file(int fd, std::uint64_t offset, size_t size, CancelContext* cancel = nullptr) {
+                std::string buf;
+                buf.resize(size < file_copy_size ? size : file_copy_size);
+                while (size) {
+                    auto res = read_file_at(fd, buf.data(), size < buf.size() ? size : buf.size(), offset);
+                    if (res <= 0) {
+                        return false;
+                    }
+                    if (!write(buf.data(), (size_t)res, cancel)) {
+                        return false;
+                    }
+                    offset += (std::uint64_t)res;
+                    size -= (size_t)res;
+                }
+                return true;
+            }
+
             virtual bool reset(IResetContext& set) override {
                 del_addrinfo(info);
                 return copy_addrinfo(info, (::addrinfo*)set.context((size_t)ResetIndex::addrinfo));
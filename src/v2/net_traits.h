@@ -7,6 +7,7 @@
 
 #pragma once
 #include <reader.h>
+#include <string_view>
 namespace socklib {
     namespace v2 {
 #ifdef COMMONLIB2_HAS_CONCEPTS
@@ -52,15 +53,13 @@ namespace socklib {
 
         template <class Table, class String>
         concept HpackDynamycTable = requires(Table t) {
-            {t.push_front({std::declval<String>(), std::declval<String>()})};
-            {t.begin() != t.end()};
-            {(*t.begin()).first};
-            {(*t.begin()).second};
+            {t.push_front(std::declval<String>(), std::declval<String>())};
+            {t.evict(size_t())};
+            {t.find_field(std::string_view(), std::string_view(), std::declval<size_t&>())};
+            {t.find_name(std::string_view(), std::declval<size_t&>())};
             {t.size()};
-            {t.back().first};
-            {t.back().second};
-            {t.pop_back()};
-            {t[1]};
+            {t[1].first};
+            {t[1].second};
         };
 #endif
     }  // namespace v2
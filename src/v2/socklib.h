@@ -11,15 +11,21 @@ namespace socklib {
     namespace v2 {
         using String = std::string;
         using HttpHeader = std::multimap<String, String>;
-        using HpackTable = std::deque<std::pair<String, String>>;
+        using HpackTable = HpackDynamicTable<String>;
 
         template <class... Arg>
         using Http2MapType = std::map<Arg...>;
 
+        using DefHttpConnPool = HttpConnPool<String, HttpHeader, String, Http2MapType, HpackTable>;
+
         std::shared_ptr<ClientRequestProxy<String, HttpHeader, String, Http2MapType, HpackTable>> make_request() {
             return make_request<String, HttpHeader, String, Http2MapType, HpackTable>();
         }
 
+        std::shared_ptr<ClientRequestProxy<String, HttpHeader, String, Http2MapType, HpackTable>> make_request(std::shared_ptr<DefHttpConnPool> pool) {
+            return make_request<String, HttpHeader, String, Http2MapType, HpackTable>(std::move(pool));
+        }
+
         std::shared_ptr<ServerRequestProxy<String, HttpHeader, String, Http2MapType, HpackTable>> accept_request(std::shared_ptr<InetConn>&& conn) {
             return accept_request<String, HttpHeader, String, Http2MapType, HpackTable>(std::move(conn));
         }
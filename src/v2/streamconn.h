@@ -8,71 +8,509 @@
 #pragma once
 
 #include "iconn.h"
+#include "../common/io_wait.h"
+#include <map>
+#include <deque>
+#include <vector>
+#include <mutex>
+#include <string>
+#ifndef _WIN32
+#include <sys/uio.h>
+#include <climits>
+#endif
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
 
 namespace socklib {
     namespace v2 {
 
+        constexpr size_t min_recvbuf_size = 16 * 1024;
+        constexpr size_t default_recvbuf_size = 64 * 1024;
+        constexpr size_t max_recvbuf_size = 256 * 1024;
+        constexpr size_t default_send_high_watermark = 1024 * 1024;
+        constexpr size_t default_send_low_watermark = 256 * 1024;
+
+#ifdef MSG_NOSIGNAL
+        constexpr int send_flags = MSG_NOSIGNAL;
+#else
+        constexpr int send_flags = 0;
+#endif
+
+        enum class SendState {
+            done,
+            blocked,
+            failed,
+        };
+
+        //RecvBufferPool - process wide pool of receive buffers
+        struct RecvBufferPool {
+           private:
+            std::mutex lock;
+            std::map<size_t, std::vector<char*>> pool;
+            size_t max_cache = 64;
+
+            RecvBufferPool() {}
+
+           public:
+            static RecvBufferPool& instance() {
+                static RecvBufferPool inst;
+                return inst;
+            }
+
+            static size_t fit_size(size_t size) {
+                if (size < min_recvbuf_size) return min_recvbuf_size;
+                if (size > max_recvbuf_size) return max_recvbuf_size;
+                return size;
+            }
+
+            char* acquire(size_t size) {
+                {
+                    std::lock_guard<std::mutex> guard(lock);
+                    auto& list = pool[size];
+                    if (list.size()) {
+                        auto ret = list.back();
+                        list.pop_back();
+                        return ret;
+                    }
+                }
+                return new char[size];
+            }
+
+            void release(char* buf, size_t size) {
+                if (!buf) return;
+                {
+                    std::lock_guard<std::mutex> guard(lock);
+                    auto& list = pool[size];
+                    if (list.size() < max_cache) {
+                        list.push_back(buf);
+                        return;
+                    }
+                }
+                delete[] buf;
+            }
+
+            void set_max_cache(size_t max) {
+                std::lock_guard<std::mutex> guard(lock);
+                max_cache = max;
+            }
+
+            ~RecvBufferPool() {
+                for (auto& list : pool) {
+                    for (auto buf : list.second) {
+                        delete[] buf;
+                    }
+                }
+            }
+        };
+
         //StreamConn - connection for tcp socket (SOCK_STREAM)
         struct StreamConn : InetConn {
            protected:
             SOCKET sock = invalid_socket;
+            char* recvbuf = nullptr;
+            size_t recvbuf_size = default_recvbuf_size;
 
-           public:
-            StreamConn(int s, ::addrinfo* p)
-                : sock(s), InetConn(p) {}
+            //get span to receive data; span of toread is used if provided
+            char* recv_span(IReadContext& toread, size_t& cap, bool& direct) {
+                if (auto ptr = toread.reserve(recvbuf_size, cap); ptr && cap) {
+                    direct = true;
+                    return ptr;
+                }
+                direct = false;
+                if (!recvbuf) {
+                    recvbuf = RecvBufferPool::instance().acquire(recvbuf_size);
+                }
+                cap = recvbuf_size;
+                return recvbuf;
+            }
 
-            virtual bool write(IWriteContext& towrite, CancelContext* cancel = nullptr) override {
-                //TODO:replace to OSErrorContext
-                OsErrorContext ctx((bool)towrite.flags(), cancel);
+            void release_recvbuf() {
+                RecvBufferPool::instance().release(recvbuf, recvbuf_size);
+                recvbuf = nullptr;
+            }
+
+            //sendq holds data which couldn't be sent without blocking (only when cancel_when_block is set)
+            std::deque<std::string> sendq;
+            size_t sendq_offset = 0;  //sent bytes of sendq.front()
+            size_t queued = 0;
+            size_t high_watermark = default_send_high_watermark;
+            size_t low_watermark = default_send_low_watermark;
+
+            //send_once sends data once
+            //returns sent bytes, 0 if it would block (want_read is set if it should wait for readable)
+            //or -1 if failed
+            virtual std::int64_t send_once(const char* ptr, size_t size, bool& want_read, OsErrorContext& ctx) {
+                while (true) {
+                    auto res = ::send(sock, ptr, size <= intmaximum ? (int)size : (int)intmaximum, send_flags);
+                    if (res >= 0) {
+                        return res;
+                    }
+#ifndef _WIN32
+                    if (errno == EINTR) continue;
+#endif
+                    if (io_would_block()) {
+                        return 0;
+                    }
+                    ctx.on_cancel();
+                    return -1;
+                }
+            }
+
+            //send_file_once sends file data once by sendfile(2)
+            //returns sent bytes, 0 if it would block or -1 if failed
+            //copy is set if file can't be sent by sendfile(2) (fd is not regular file or platform has no sendfile)
+            virtual std::int64_t send_file_once(int fd, std::uint64_t offset, size_t size, bool& copy, OsErrorContext& ctx) {
+#ifdef __linux__
+                while (true) {
+                    ::off_t off = (::off_t)offset;
+                    auto res = ::sendfile(sock, fd, &off, size <= intmaximum ? size : intmaximum);
+                    if (res > 0) {
+                        return res;
+                    }
+                    if (res == 0) {
+                        //file is shorter than size
+                        return -1;
+                    }
+                    if (errno == EINTR) continue;
+                    if (io_would_block()) {
+                        return 0;
+                    }
+                    if (errno == EINVAL || errno == ENOSYS || errno == EOPNOTSUPP) {
+                        copy = true;
+                        return -1;
+                    }
+                    ctx.on_cancel();
+                    return -1;
+                }
+#else
+                copy = true;
+                return -1;
+#endif
+            }
+
+            virtual void on_write_error(IWriteContext& towrite, OsErrorContext& ctx) {
+                towrite.on_error(ctx.err, &ctx, "");
+            }
+
+            //wait until sock becomes writable
+            //returns SendState::blocked without waiting if cancel_when_block is set
+            SendState wait_send(OsErrorContext& ctx, CancelContext* cancel, bool want_read) {
+                if (ctx.cancel_when_block) {
+                    return SendState::blocked;
+                }
+                if (wait_io(sock, !want_read, cancel) == WaitResult::ready) {
+                    return SendState::done;
+                }
+                ctx.on_cancel();
+                return SendState::failed;
+            }
+
+            //send_buffer sends ptr[sent..size) and advances sent
+            SendState send_buffer(const char* ptr, size_t size, size_t& sent, OsErrorContext& ctx, CancelContext* cancel) {
+                while (sent < size) {
+                    bool want_read = false;
+                    auto res = send_once(ptr + sent, size - sent, want_read, ctx);
+                    if (res < 0) {
+                        return SendState::failed;
+                    }
+                    if (res > 0) {
+                        sent += (size_t)res;
+                        continue;
+                    }
+                    if (auto state = wait_send(ctx, cancel, want_read); state != SendState::done) {
+                        return state;
+                    }
+                }
+                return SendState::done;
+            }
+
+            void enqueue(const char* ptr, size_t size) {
+                if (!ptr || !size) return;
+                sendq.emplace_back(ptr, size);
+                queued += size;
+            }
+
+            //enqueue current and rest buffers of towrite
+            void enqueue_all(IWriteContext& towrite) {
+                const IOVec* vec = nullptr;
+                if (auto count = towrite.vectors(vec); count && vec) {
+                    for (size_t i = 0; i < count; i++) {
+                        enqueue(vec[i].ptr, vec[i].size);
+                    }
+                    return;
+                }
                 while (true) {
                     auto ptr = towrite.bufptr();
                     auto size = towrite.size();
                     if (!ptr || !size) {
                         break;
                     }
-                    size_t offset = 0;
-                    while (size) {
-                        auto res = 0;
-                        if (size <= intmaximum) {
-                            res = ::send(sock, ptr + offset, (int)size, 0);
+                    enqueue(ptr, size);
+                    if (towrite.done()) break;
+                }
+            }
+
+            //flush_queue sends queued data in order
+            SendState flush_queue(OsErrorContext& ctx, CancelContext* cancel) {
+                while (sendq.size()) {
+                    auto& front = sendq.front();
+                    auto prev = sendq_offset;
+                    auto state = send_buffer(front.data(), front.size(), sendq_offset, ctx, cancel);
+                    queued -= sendq_offset - prev;
+                    if (state != SendState::done) {
+                        return state;
+                    }
+                    sendq.pop_front();
+                    sendq_offset = 0;
+                }
+                return SendState::done;
+            }
+
+            bool write_impl(IWriteContext& towrite, OsErrorContext& ctx, CancelContext* cancel) {
+                //queued data must be sent before new data to keep order
+                if (auto state = flush_queue(ctx, cancel); state != SendState::done) {
+                    if (state == SendState::failed) {
+                        on_write_error(towrite, ctx);
+                        return false;
+                    }
+                    if (queued >= high_watermark) {
+                        ctx.cancel_by_block();
+                        towrite.on_error(ctx.err, &ctx, "send queue is full");
+                        return false;
+                    }
+                    enqueue_all(towrite);
+                    return true;
+                }
+                const IOVec* vec = nullptr;
+                if (auto count = towrite.vectors(vec); count && vec) {
+                    return write_vectors(vec, count, towrite, ctx, cancel);
+                }
+                while (true) {
+                    auto ptr = towrite.bufptr();
+                    auto size = towrite.size();
+                    if (!ptr || !size) {
+                        break;
+                    }
+                    size_t sent = 0;
+                    auto state = send_buffer(ptr, size, sent, ctx, cancel);
+                    if (state == SendState::failed) {
+                        on_write_error(towrite, ctx);
+                        return false;
+                    }
+                    if (state == SendState::blocked) {
+                        enqueue(ptr + sent, size - sent);
+                        while (!towrite.done()) {
+                            enqueue(towrite.bufptr(), towrite.size());
                         }
-                        else {
-                            res = ::send(sock, ptr + offset, (int)intmaximum, 0);
+                        return true;
+                    }
+                    if (towrite.done()) break;
+                }
+                return true;
+            }
+
+            virtual bool write_vectors(const IOVec* vec, size_t count, IWriteContext& towrite, OsErrorContext& ctx, CancelContext* cancel) {
+#ifdef _WIN32
+                using iovec_t = ::WSABUF;
+                auto set_vec = [](iovec_t& v, const IOVec& src) {
+                    v.buf = (CHAR*)src.ptr;
+                    v.len = (ULONG)src.size;
+                };
+                auto vec_ptr = [](iovec_t& v) -> const char* { return v.buf; };
+                auto vec_len = [](iovec_t& v) -> size_t { return v.len; };
+                auto advance = [](iovec_t& v, size_t n) {
+                    v.buf += n;
+                    v.len -= (ULONG)n;
+                };
+                constexpr size_t max_vec = 1024;
+#else
+                using iovec_t = ::iovec;
+                auto set_vec = [](iovec_t& v, const IOVec& src) {
+                    v.iov_base = (void*)src.ptr;
+                    v.iov_len = src.size;
+                };
+                auto vec_ptr = [](iovec_t& v) -> const char* { return (const char*)v.iov_base; };
+                auto vec_len = [](iovec_t& v) -> size_t { return v.iov_len; };
+                auto advance = [](iovec_t& v, size_t n) {
+                    v.iov_base = (char*)v.iov_base + n;
+                    v.iov_len -= n;
+                };
+                constexpr size_t max_vec = IOV_MAX;
+#endif
+                std::vector<iovec_t> iov;
+                iov.reserve(count);
+                for (size_t i = 0; i < count; i++) {
+                    if (!vec[i].ptr || !vec[i].size) continue;
+                    //split too large buffer (WSABUF::len is ULONG)
+                    IOVec piece = vec[i];
+                    while (piece.size) {
+                        IOVec cur{piece.ptr, piece.size < intmaximum ? piece.size : intmaximum};
+                        iovec_t v;
+                        set_vec(v, cur);
+                        iov.push_back(v);
+                        piece.ptr += cur.size;
+                        piece.size -= cur.size;
+                    }
+                }
+                size_t idx = 0;
+                while (idx < iov.size()) {
+                    size_t n = iov.size() - idx < max_vec ? iov.size() - idx : max_vec;
+#ifdef _WIN32
+                    DWORD sent = 0;
+                    auto res = ::WSASend(sock, iov.data() + idx, (DWORD)n, &sent, 0, nullptr, nullptr);
+                    std::int64_t written = res == 0 ? (std::int64_t)sent : -1;
+#else
+                    ::msghdr msg = {0};
+                    msg.msg_iov = iov.data() + idx;
+                    msg.msg_iovlen = n;
+                    std::int64_t written = ::sendmsg(sock, &msg, send_flags);
+                    if (written < 0 && errno == EINTR) continue;
+#endif
+                    if (written < 0) {
+                        if (!io_would_block()) {
+                            ctx.on_cancel();
+                            on_write_error(towrite, ctx);
+                            return false;
+                        }
+                        auto state = wait_send(ctx, cancel, false);
+                        if (state == SendState::failed) {
+                            on_write_error(towrite, ctx);
+                            return false;
                         }
-                        if (res < 0) {
-                            if (ctx.on_cancel()) {
-                                towrite.on_error(ctx.err, &ctx, "");
-                                return false;
+                        if (state == SendState::blocked) {
+                            for (; idx < iov.size(); idx++) {
+                                enqueue(vec_ptr(iov[idx]), vec_len(iov[idx]));
                             }
-                            continue;
+                            return true;
                         }
-                        if (size > intmaximum) {
-                            size -= intmaximum;
+                        continue;
+                    }
+                    size_t w = (size_t)written;
+                    while (w && idx < iov.size()) {
+                        auto len = vec_len(iov[idx]);
+                        if (w >= len) {
+                            w -= len;
+                            idx++;
                         }
                         else {
-                            break;
+                            advance(iov[idx], w);
+                            w = 0;
                         }
-                        offset += intmaximum;
                     }
-                    if (towrite.done()) break;
                 }
                 return true;
             }
 
+           public:
+            StreamConn(int s, ::addrinfo* p)
+                : sock(s), InetConn(p) {}
+
+            //write sends all data of towrite
+            //if towrite.flags() has cancel_when_block, data which couldn't be sent without blocking
+            //is queued and sent by next write() or flush(). in this case, write() fails
+            //as CancelReason::blocking when queued data is over high watermark
+            virtual bool write(IWriteContext& towrite, CancelContext* cancel = nullptr) override {
+                OsErrorContext ctx((bool)towrite.flags(), cancel);
+                return write_impl(towrite, ctx, cancel);
+            }
+
+            //flush sends queued data
+            //if cancel_when_block is set, returns true with data left in queue when it would block
+            virtual bool flush(CancelContext* cancel = nullptr, bool cancel_when_block = false) {
+                OsErrorContext ctx(cancel_when_block, cancel);
+                return flush_queue(ctx, cancel) != SendState::failed;
+            }
+
+            //send_file sends size bytes of file fd from offset by sendfile(2) so that file data is not copied into user space
+            //queued data is sent before it. unlike write(), this blocks until all data is sent or cancel is canceled
+            virtual bool send_file(int fd, std::uint64_t offset, size_t size, CancelContext* cancel = nullptr) override {
+                OsErrorContext ctx(false, cancel);
+                if (flush_queue(ctx, cancel) != SendState::done) {
+                    return false;
+                }
+                while (size) {
+                    bool copy = false;
+                    auto res = send_file_once(fd, offset, size, copy, ctx);
+                    if (copy) {
+                        return InetConn::send_file(fd, offset, size, cancel);
+                    }
+                    if (res < 0) {
+                        return false;
+                    }
+                    if (res > 0) {
+                        offset += (std::uint64_t)res;
+                        size -= (size_t)res;
+                        continue;
+                    }
+                    if (wait_send(ctx, cancel, false) != SendState::done) {
+                        return false;
+                    }
+                }
+                return true;
+            }
+
+            size_t queued_size() const {
+                return queued;
+            }
+
+            //set watermarks of send queue
+            //callers should stop writing while over_high_watermark() and resume when under_low_watermark()
+            void set_watermark(size_t high, size_t low) {
+                high_watermark = high;
+                low_watermark = low < high ? low : high;
+            }
+
+            bool over_high_watermark() const {
+                return queued >= high_watermark;
+            }
+
+            bool under_low_watermark() const {
+                return queued <= low_watermark;
+            }
+
             virtual bool read(IReadContext& toread, CancelContext* cancel = nullptr) override {
                 OsErrorContext ctx((bool)toread.flags(), cancel);
                 while (true) {
-                    char buf[1024] = {0};
-                    int res = ::recv(sock, buf, 1024, 0);
+                    size_t cap = 0;
+                    bool direct = false;
+                    auto buf = recv_span(toread, cap, direct);
+                    int res = ::recv(sock, buf, cap <= intmaximum ? (int)cap : (int)intmaximum, 0);
                     if (res < 0) {
+                        if (direct) {
+                            toread.commit(0);
+                        }
+                        if (!ctx.cancel_when_block && io_would_block() &&
+                            wait_io(sock, false, cancel) == WaitResult::ready) {
+                            continue;
+                        }
                         if (ctx.on_cancel()) {
                             toread.on_error(ctx.err, &ctx, "");
                             return false;
                         }
                         continue;
                     }
-                    toread.append(buf, (size_t)res);
-                    if (res < 1024) {
+                    if (res == 0) {
+                        //closed by peer. empty append lets body without length end at EOF
+                        if (direct) {
+                            toread.commit(0);
+                        }
+                        else {
+                            toread.append(buf, 0);
+                        }
+                        if (!toread.require()) {
+                            break;
+                        }
+                        toread.on_error(0, &ctx, "closed");
+                        return false;
+                    }
+                    if (direct) {
+                        toread.commit((size_t)res);
+                    }
+                    else {
+                        toread.append(buf, (size_t)res);
+                    }
+                    if ((size_t)res < cap) {
                         if (toread.require()) {
                             continue;
                         }
@@ -82,7 +520,22 @@ namespace socklib {
                 return true;
             }
 
+            //set receive buffer size (clamped between min_recvbuf_size and max_recvbuf_size)
+            void set_recvbuf_size(size_t size) {
+                release_recvbuf();
+                recvbuf_size = RecvBufferPool::fit_size(size);
+            }
+
+            size_t get_recvbuf_size() const {
+                return recvbuf_size;
+            }
+
+            //queued data which is not sent yet is discarded. call flush() before if needed
             virtual void close(CancelContext* cancel = nullptr) override {
+                release_recvbuf();
+                sendq.clear();
+                sendq_offset = 0;
+                queued = 0;
                 if (sock == invalid_socket) return;
                 ::shutdown(sock, SD_BOTH);
                 ::closesocket(sock);
@@ -100,6 +553,7 @@ namespace socklib {
                 st.type = ConnType::tcp_socket;
                 st.status = (sock == invalid_socket ? ConnStatus::none : ConnStatus::has_fd);
                 st.status |= ConnStatus::streaming;
+                st.net.sock = sock;
                 InetConn::stat(st);
                 return true;
             }
@@ -109,6 +563,14 @@ namespace socklib {
             }
         };
 
+        //request kernel TLS offload (kTLS) for ssl before its handshake
+        //OpenSSL keeps encrypting in user space if it was built without kTLS or kernel doesn't support negotiated cipher
+        inline void enable_ktls(::SSL* ssl) {
+#ifdef SSL_OP_ENABLE_KTLS
+            ::SSL_set_options(ssl, SSL_OP_ENABLE_KTLS);
+#endif
+        }
+
         //SecureStreamConn - secure connection for tcp socket (SOCK_STREAM)
         struct SecureStreamConn : StreamConn {
            protected:
@@ -116,46 +578,168 @@ namespace socklib {
             ::SSL_CTX* ctx = nullptr;
             bool noshutdown = false;
             bool nodelctx = false;
+            //records are encrypted (tx) or decrypted (rx) by kernel (see enable_ktls)
+            bool ktls_tx = false;
+            bool ktls_rx = false;
+
+            //with kTLS send, application data is sent by plain send(2) and sendfile(2) without SSL_write_ex
+            bool plain_send() const {
+                return !ssl || ktls_tx;
+            }
 
            public:
             SecureStreamConn(::SSL* issl, ::SSL_CTX* ictx, int sock, ::addrinfo* info, bool nodelctx = false)
-                : ssl(issl), ctx(ictx), nodelctx(nodelctx), StreamConn(sock, info) {}
+                : ssl(issl), ctx(ictx), nodelctx(nodelctx), StreamConn(sock, info) {
+                set_ssl_mode();
+            }
 
             virtual bool write(IWriteContext& towrite, CancelContext* cancel = nullptr) override {
-                if (!ssl) {
+                if (plain_send()) {
                     return StreamConn::write(towrite, cancel);
                 }
                 SSLErrorContext ctx(ssl, cancel, (bool)towrite.flags());
-                while (true) {
-                    auto ptr = towrite.bufptr();
-                    auto size = towrite.size();
-                    size_t wrt = 0;
-                    if (!ptr || !size) {
+                return write_impl(towrite, ctx, cancel);
+            }
+
+            virtual bool flush(CancelContext* cancel = nullptr, bool cancel_when_block = false) override {
+                if (plain_send()) {
+                    return StreamConn::flush(cancel, cancel_when_block);
+                }
+                SSLErrorContext ctx(ssl, cancel, cancel_when_block);
+                return flush_queue(ctx, cancel) != SendState::failed;
+            }
+
+           protected:
+            void set_ssl_mode() {
+                ktls_tx = false;
+                ktls_rx = false;
+                if (ssl) {
+                    //retried SSL_write may come from send queue which has another address
+                    SSL_set_mode(ssl, SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+#ifdef SSL_OP_ENABLE_KTLS
+                    //OpenSSL turns kTLS on while handshake if it is requested and kernel supports negotiated cipher
+                    ktls_tx = BIO_get_ktls_send(::SSL_get_wbio(ssl)) != 0;
+                    ktls_rx = BIO_get_ktls_recv(::SSL_get_rbio(ssl)) != 0;
+#endif
+                }
+            }
+
+            std::int64_t send_once(const char* ptr, size_t size, bool& want_read, OsErrorContext& ctx) override {
+                if (plain_send()) {
+                    return StreamConn::send_once(ptr, size, want_read, ctx);
+                }
+                size_t wrt = 0;
+                auto res = SSL_write_ex(ssl, ptr, size, &wrt);
+                if (res) {
+                    return (std::int64_t)wrt;
+                }
+                switch (SSL_get_error(ssl, res)) {
+                    case SSL_ERROR_WANT_WRITE:
+                        return 0;
+                    case SSL_ERROR_WANT_READ:
+                        want_read = true;
+                        return 0;
+                    default:
                         break;
+                }
+                ctx.on_cancel();
+                return -1;
+            }
+
+            void on_write_error(IWriteContext& towrite, OsErrorContext& ctx) override {
+                if (ctx.reason() == CancelReason::ssl_error || ctx.reason() == CancelReason::os_error) {
+                    noshutdown = true;
+                }
+                towrite.on_error(ctx.err, &ctx, "ssl");
+            }
+
+            //OpenSSL has no gathered write, so small buffers are coalesced up to one TLS record
+            //to avoid emitting a record (and a syscall) per buffer. large buffers are written directly
+            bool write_vectors(const IOVec* vec, size_t count, IWriteContext& towrite, OsErrorContext& ctx, CancelContext* cancel) override {
+                if (plain_send()) {
+                    return StreamConn::write_vectors(vec, count, towrite, ctx, cancel);
+                }
+                constexpr size_t record_size = 16 * 1024;
+                std::string staging;
+                auto send_piece = [&](const char* ptr, size_t size) {
+                    size_t sent = 0;
+                    auto state = send_buffer(ptr, size, sent, ctx, cancel);
+                    if (state == SendState::blocked) {
+                        enqueue(ptr + sent, size - sent);
                     }
-                    while (!SSL_write_ex(ssl, ptr, size, &wrt)) {
-                        if (ctx.on_cancel()) {
-                            if (ctx.reason() == CancelReason::ssl_error || ctx.reason() == CancelReason::os_error) {
-                                noshutdown = true;
-                            }
-                            towrite.on_error(ctx.err, &ctx, "ssl");
-                            return false;
-                        }
+                    return state;
+                };
+                auto state = SendState::done;
+                size_t i = 0;
+                while (i < count) {
+                    if (!vec[i].ptr || !vec[i].size) {
+                        i++;
+                        continue;
                     }
-                    if (towrite.done()) {
-                        break;
+                    if (staging.size() + vec[i].size <= record_size) {
+                        staging.append(vec[i].ptr, vec[i].size);
+                        i++;
+                        continue;
+                    }
+                    if (staging.size()) {
+                        state = send_piece(staging.data(), staging.size());
+                        staging.clear();
+                        if (state != SendState::done) break;
+                        continue;
                     }
+                    state = send_piece(vec[i].ptr, vec[i].size);
+                    i++;
+                    if (state != SendState::done) break;
+                }
+                if (state == SendState::done && staging.size()) {
+                    state = send_piece(staging.data(), staging.size());
+                }
+                if (state == SendState::failed) {
+                    on_write_error(towrite, ctx);
+                    return false;
+                }
+                for (; i < count; i++) {
+                    enqueue(vec[i].ptr, vec[i].size);
                 }
                 return true;
             }
 
+           public:
+            //with kTLS, file data is sent by sendfile(2) and encrypted by kernel
+            //otherwise it is read into user space and encrypted by SSL_write_ex
+            virtual bool send_file(int fd, std::uint64_t offset, size_t size, CancelContext* cancel = nullptr) override {
+                if (plain_send()) {
+                    return StreamConn::send_file(fd, offset, size, cancel);
+                }
+                return InetConn::send_file(fd, offset, size, cancel);
+            }
+
+            bool ktls_send() const {
+                return ktls_tx;
+            }
+
+            bool ktls_recv() const {
+                return ktls_rx;
+            }
+
+            //with kTLS receive, SSL_read_ex still reads because records other than application data
+            //(alert, NewSessionTicket, KeyUpdate) are passed as control messages which OpenSSL handles
             virtual bool read(IReadContext& toread, CancelContext* cancel = nullptr) override {
                 if (!ssl) return StreamConn::read(toread, cancel);
                 SSLErrorContext ctx(ssl, cancel, (bool)toread.flags());
                 while (true) {
-                    size_t red = 0;
-                    char data[1024] = {0};
-                    while (!SSL_read_ex(ssl, data, 1024, &red)) {
+                    size_t red = 0, cap = 0;
+                    bool direct = false;
+                    auto data = recv_span(toread, cap, direct);
+                    while (!SSL_read_ex(ssl, data, cap, &red)) {
+                        if (!toread.flags()) {
+                            auto sslerr = ::SSL_get_error(ssl, 0);
+                            if (sslerr == SSL_ERROR_WANT_READ || sslerr == SSL_ERROR_WANT_WRITE) {
+                                if (wait_io(sock, sslerr == SSL_ERROR_WANT_WRITE, cancel) == WaitResult::ready) {
+                                    continue;
+                                }
+                            }
+                        }
                         if (ctx.on_cancel()) {
                             std::string errstr = "ssl";
                             if (ctx.reason() == CancelReason::ssl_error || ctx.reason() == CancelReason::os_error) {
@@ -171,12 +755,21 @@ namespace socklib {
                                 }
                             }
                             noshutdown = true;
+                            if (direct) {
+                                toread.commit(0);
+                            }
                             toread.on_error(ctx.err, &ctx, errstr.c_str());
                             return false;
                         }
                     }
-                    toread.append(data, red);
-                    if (red < 1024) {
+                    if (direct) {
+                        toread.commit(red);
+                    }
+                    else {
+                        toread.append(data, red);
+                    }
+                    //SSL_read_ex returns at most one record, so check buffered data too
+                    if (red < cap && !SSL_has_pending(ssl)) {
                         if (toread.require()) {
                             continue;
                         }
@@ -197,6 +790,7 @@ namespace socklib {
                 ssl = (::SSL*)set.context((size_t)ResetIndex::ssl);
                 ctx = (::SSL_CTX*)set.context((size_t)ResetIndex::ssl_ctx);
                 nodelctx = (bool)set.context((size_t)ResetIndex::nodel_ctx);
+                set_ssl_mode();
                 StreamConn::reset(set);
                 return true;
             }
@@ -236,6 +830,7 @@ namespace socklib {
                 st.status |= ConnStatus::streaming;
                 st.net.ssl = ssl;
                 st.net.ssl_ctx = ctx;
+                st.net.sock = sock;
                 InetConn::stat(st);
                 return true;
             }
@@ -8,9 +8,14 @@
 #pragma once
 
 #include "streamconn.h"
+#include "../common/io_wait.h"
+#include "../common/ssl_ctx_cache.h"
 #include <reader.h>
 #include <callback_invoker.h>
 #include <memory>
+#include <vector>
+#include <deque>
+#include <chrono>
 
 namespace socklib {
     namespace v2 {
@@ -37,8 +42,27 @@ namespace socklib {
             no_socket,
             wait_accept,
             accept,
+            ssl_accept,
+            load_certificate,
         };
 
+        //disable Nagle's algorithm so that small frames (like HTTP/2 WINDOW_UPDATE) are not delayed
+        inline bool set_no_delay(SOCKET sock) {
+            int flag = 1;
+            return ::setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, (char*)&flag, sizeof(flag)) == 0;
+        }
+
+        //size of kernel receive buffer of sock (may grow by auto tuning)
+        //returns 0 if failed
+        inline size_t recv_buffer_size(SOCKET sock) {
+            int size = 0;
+            ::socklen_t len = sizeof(size);
+            if (::getsockopt(sock, SOL_SOCKET, SO_RCVBUF, (char*)&size, &len) < 0 || size < 0) {
+                return 0;
+            }
+            return (size_t)size;
+        }
+
         template <class String>
         struct TCPOpenContext {
             using string_t = String;
@@ -53,6 +77,21 @@ namespace socklib {
             size_t len = 0;
             bool forceopen = false;
             bool non_block = true;
+            bool happy_eyeballs = false;             //race connection attempts across address families (RFC 8305)
+            std::uint32_t attempt_delay_msec = 250;  //delay between starting each attempt when happy_eyeballs
+            bool no_delay = true;                    //see set_no_delay
+            size_t recvbuf_size = default_recvbuf_size;
+            bool ktls = false;  //see enable_ktls
+        };
+
+        //TLS handshake of accepted connection in progress (see TCPAcceptContext::nonblock_handshake)
+        struct TLSHandshake {
+            SOCKET sock = invalid_socket;
+            ::SSL* ssl = nullptr;
+            ::sockaddr_storage addr = {0};
+            ::socklen_t addrlen = 0;
+            bool want_write = false;
+            std::chrono::steady_clock::time_point deadline;
         };
 
         template <class String>
@@ -63,7 +102,10 @@ namespace socklib {
             std::uint16_t port = 0;
             string_t service;
             string_t servercert;
+            string_t serverkey;  //if empty, servercert is used as private key file
             string_t rootcert;
+            const char* alpnstr = nullptr;  //ALPN protocols in server preference order (wire format)
+            size_t len = 0;
             ConnStat stat;  //to set stat
             bool non_block = true;
             ::SSL* ssl = nullptr;
@@ -71,7 +113,21 @@ namespace socklib {
             TCPError err = TCPError::none;
             ::addrinfo* info = nullptr;
             bool reuse_addr = true;
+            bool no_delay = true;  //see set_no_delay
+            size_t recvbuf_size = default_recvbuf_size;
+            bool ktls = false;  //see enable_ktls
+            //if set, TLS handshakes are done without blocking and many handshakes progress at once in TCP::accept
+            //so that slow or stalled client doesn't stop other clients from being accepted
+            bool nonblock_handshake = true;
+            std::uint32_t handshake_timeout_msec = 10000;
+            size_t max_handshakes = 1024;
+            std::uint32_t ticket_rotation_sec = 3600;  //see SSLTicketKeys
+            std::deque<TLSHandshake> handshakes;
             ~TCPAcceptContext() {
+                for (auto& h : handshakes) {
+                    ::SSL_free(h.ssl);
+                    ::closesocket(h.sock);
+                }
                 if (ssl) {
                     ::SSL_free(ssl);
                 }
@@ -117,6 +173,18 @@ namespace socklib {
                 static bool res = Init_impl();
                 return res;
             }
+
+            //ignore SIGPIPE for whole process unless its handler is already set
+            //TLS records (written through socket BIO) and sendfile(2) don't use MSG_NOSIGNAL,
+            //so application which doesn't handle SIGPIPE itself should call this before writing to peer which may close
+            static void ignore_sigpipe() {
+#ifndef _WIN32
+                struct ::sigaction act = {0};
+                if (::sigaction(SIGPIPE, nullptr, &act) == 0 && act.sa_handler == SIG_DFL) {
+                    ::signal(SIGPIPE, SIG_IGN);
+                }
+#endif
+            }
         };
 
         template <class String>
@@ -159,7 +227,6 @@ namespace socklib {
             }
 
             static bool connect_loop(::addrinfo* info, SOCKET& sock, TCPOpenContext<String>& ctx, CancelContext* cancel) {
-                OsErrorContext canceler(cancel);
                 auto tmp = ::socket(info->ai_family, info->ai_socktype, info->ai_protocol);
                 if (tmp < 0 || tmp == invalid_socket) return false;
                 u_long flag = 1;
@@ -176,30 +243,145 @@ namespace socklib {
                 if (res == 0) {
                     return when_connected();
                 }
-                ::timeval timeout = {0};
-                ::fd_set baseset = {0}, sucset = {0}, errset = {0};
-                FD_ZERO(&baseset);
-                FD_SET(tmp, &baseset);
-                while (true) {
-                    memcpy(&sucset, &baseset, sizeof(::fd_set));
-                    memcpy(&errset, &baseset, sizeof(::fd_set));
-                    timeout.tv_sec = 0;
-                    timeout.tv_usec = 1;
-                    res = ::select(tmp + 1, nullptr, &sucset, &errset, &timeout);
-                    if (res < 0) {
+                if (!connect_in_progress()) {
+                    ::closesocket(tmp);
+                    ctx.err = TCPError::connect;
+                    return false;
+                }
+                switch (wait_connect(tmp, cancel)) {
+                    case WaitResult::ready:
+                        return when_connected();
+                    case WaitResult::canceled:
                         ::closesocket(tmp);
+                        ctx.err = TCPError::canceled;
                         return false;
-                    }
-                    if (FD_ISSET(tmp, &errset)) {
+                    default:
                         ::closesocket(tmp);
                         ctx.err = TCPError::connect;
                         return false;
+                }
+            }
+
+            //sort addresses so that address families are interleaved (RFC 8305 section 4)
+            static void interleave_family(::addrinfo* info, std::vector<::addrinfo*>& order) {
+                std::deque<::addrinfo*> first, second;
+                int first_family = info ? info->ai_family : AF_UNSPEC;
+                for (auto p = info; p; p = p->ai_next) {
+                    if (p->ai_family == first_family) {
+                        first.push_back(p);
                     }
-                    if (FD_ISSET(tmp, &sucset)) {
-                        return when_connected();
+                    else {
+                        second.push_back(p);
                     }
-                    if (canceler.on_cancel()) {
-                        ::closesocket(tmp);
+                }
+                while (first.size() || second.size()) {
+                    if (first.size()) {
+                        order.push_back(first.front());
+                        first.pop_front();
+                    }
+                    if (second.size()) {
+                        order.push_back(second.front());
+                        second.pop_front();
+                    }
+                }
+            }
+
+            //start connection attempts staggered by ctx.attempt_delay_msec and keep first one succeeded
+            static bool connect_race(TCPOpenContext<String>& ctx, CancelContext* cancel, SOCKET& sock, std::vector<::addrinfo*>& order, ::addrinfo*& selected) {
+                using clock = std::chrono::steady_clock;
+                struct Attempt {
+                    SOCKET sock = invalid_socket;
+                    ::addrinfo* info = nullptr;
+                };
+                std::vector<Attempt> attempts;
+                std::vector<pollfd_t> fds;
+                size_t next = 0;
+                auto next_start = clock::now();
+                auto close_attempts = [&](SOCKET except) {
+                    for (auto& a : attempts) {
+                        if (a.sock != except) {
+                            ::closesocket(a.sock);
+                        }
+                    }
+                    attempts.clear();
+                };
+                auto when_connected = [&](SOCKET tmp, ::addrinfo* info) {
+                    close_attempts(tmp);
+                    sock = tmp;
+                    selected = info;
+                    if (!ctx.non_block) {
+                        u_long flag = 0;
+                        ::ioctlsocket(tmp, FIONBIO, &flag);
+                    }
+                    return true;
+                };
+                while (true) {
+                    auto now = clock::now();
+                    if (next < order.size() && (attempts.empty() || now >= next_start)) {
+                        auto info = order[next];
+                        next++;
+                        auto tmp = ::socket(info->ai_family, info->ai_socktype, info->ai_protocol);
+                        if (tmp < 0 || tmp == invalid_socket) continue;
+                        u_long flag = 1;
+                        ::ioctlsocket(tmp, FIONBIO, &flag);
+                        if (::connect(tmp, info->ai_addr, info->ai_addrlen) == 0) {
+                            return when_connected(tmp, info);
+                        }
+                        if (!connect_in_progress()) {
+                            ::closesocket(tmp);
+                            continue;
+                        }
+                        attempts.push_back({tmp, info});
+                        next_start = now + std::chrono::milliseconds(ctx.attempt_delay_msec);
+                        continue;
+                    }
+                    if (attempts.empty()) {
+                        ctx.err = TCPError::no_address_to_connect;
+                        return false;
+                    }
+                    long long msec = io_wait_slice_msec;
+                    if (next < order.size()) {
+                        auto until = std::chrono::duration_cast<std::chrono::milliseconds>(next_start - now).count();
+                        if (until < msec) msec = until;
+                    }
+                    if (cancel) {
+                        auto rem = cancel->remaining_msec();
+                        if (rem >= 0 && rem < msec) msec = rem;
+                    }
+                    if (msec < 0) msec = 0;
+                    fds.resize(attempts.size());
+                    for (size_t i = 0; i < attempts.size(); i++) {
+                        fds[i] = {0};
+                        fds[i].fd = attempts[i].sock;
+                        fds[i].events = POLLOUT;
+                    }
+                    auto res = poll_fds(fds.data(), fds.size(), (int)msec);
+                    if (res < 0) {
+                        close_attempts(invalid_socket);
+                        ctx.err = TCPError::connect;
+                        return false;
+                    }
+                    if (res > 0) {
+                        bool failed = false;
+                        for (size_t i = fds.size(); i > 0; i--) {
+                            auto& fd = fds[i - 1];
+                            if (!fd.revents) continue;
+                            auto& a = attempts[i - 1];
+                            if (!(fd.revents & POLLNVAL) && connect_error(a.sock) == 0) {
+                                return when_connected(a.sock, a.info);
+                            }
+                            ::closesocket(a.sock);
+                            attempts.erase(attempts.begin() + (i - 1));
+                            failed = true;
+                        }
+                        if (failed) {
+                            //start next attempt immediately when one failed
+                            next_start = clock::now();
+                        }
+                        continue;
+                    }
+                    if (cancel && cancel->on_cancel()) {
+                        close_attempts(invalid_socket);
                         ctx.err = TCPError::canceled;
                         return false;
                     }
@@ -209,6 +391,7 @@ namespace socklib {
             template <class Check = bool (*)(::addrinfo*, bool*)>
             static bool connect(TCPOpenContext<String>& ctx, CancelContext* cancel, SOCKET& sock, ::addrinfo* info, ::addrinfo*& selected, Check&& check = Check()) {
                 std::uint16_t port = commonlib2::translate_byte_net_and_host<std::uint16_t>(&ctx.port);
+                std::vector<::addrinfo*> order;
                 for (auto p = info; p; p = p->ai_next) {
                     ::sockaddr_in* addr = (::sockaddr_in*)p->ai_addr;
                     if (port) {
@@ -218,11 +401,18 @@ namespace socklib {
                     if (!commonlib2::invoke_cb<Check, bool>::invoke(std::forward<Check>(check), p, &result)) {
                         return result;
                     }
+                    if (ctx.happy_eyeballs) {
+                        continue;
+                    }
                     if (connect_loop(p, sock, ctx, cancel)) {
                         selected = p;
                         return true;
                     }
                 }
+                if (ctx.happy_eyeballs) {
+                    interleave_family(info, order);
+                    return connect_race(ctx, cancel, sock, order, selected);
+                }
                 ctx.err = TCPError::no_address_to_connect;
                 return false;
             }
@@ -247,31 +437,33 @@ namespace socklib {
             }
 
             template <class String>
-            static bool setupssl_detail(int sock, SSL_CTX*& sslctx, SSL*& ssl, TCPOpenContext<String>& ctx, const char* host, const char* cacert, CancelContext* cancel) {
+            static bool setupssl_detail(int sock, SSL_CTX*& sslctx, SSL*& ssl, TCPOpenContext<String>& ctx, const char* host, const char* service, const char* cacert, CancelContext* cancel) {
                 bool has_ctx = false, has_ssl = false;
                 if (!sslctx) {
                     if (ssl) {
                         ctx.err = TCPError::has_ssl_but_ctx;
                         return false;
                     }
-                    sslctx = SSL_CTX_new(TLS_method());
+                    //peer certificate is verified after handshake (see below)
+                    SSLCtxError err = SSLCtxError::none;
+                    sslctx = SSLCtxCache::instance().get(cacert, ctx.alpnstr, ctx.len, SSL_VERIFY_NONE, &err);
                     if (!sslctx) {
-                        ctx.err = TCPError::memory;
+                        ctx.err = err == SSLCtxError::cacert ? TCPError::register_cacert : TCPError::memory;
                         return false;
                     }
                 }
                 else {
                     has_ctx = true;
-                }
-                SSL_CTX_set_options(sslctx, SSL_OP_NO_SSLv2);
-                if (cacert) {
-                    if (!SSL_CTX_load_verify_locations(sslctx, cacert, nullptr)) {
-                        ctx.err = TCPError::register_cacert;
-                        return false;
+                    SSL_CTX_set_options(sslctx, SSL_OP_NO_SSLv2);
+                    if (cacert) {
+                        if (!SSL_CTX_load_verify_locations(sslctx, cacert, nullptr)) {
+                            ctx.err = TCPError::register_cacert;
+                            return false;
+                        }
+                    }
+                    if (ctx.alpnstr && ctx.len) {
+                        SSL_CTX_set_alpn_protos(sslctx, (const unsigned char*)ctx.alpnstr, ctx.len);
                     }
-                }
-                if (ctx.alpnstr && ctx.len) {
-                    SSL_CTX_set_alpn_protos(sslctx, (const unsigned char*)ctx.alpnstr, ctx.len);
                 }
                 if (!ssl) {
                     ssl = SSL_new(sslctx);
@@ -286,7 +478,20 @@ namespace socklib {
                     //SSL_set_alpn_protos(ssl, (const unsigned char*)ctx.alpnstr, ctx.len);
                 }
                 SSL_set_fd(ssl, sock);
+                if (ctx.ktls) {
+                    enable_ktls(ssl);
+                }
                 SSL_set_tlsext_host_name(ssl, host);
+                if (!has_ctx) {
+                    //SSL_CTX from SSLCtxCache stores sessions into SSLSessionCache
+                    //cacert is part of key because resumed session skips certificate verification
+                    std::string key = host;
+                    key += ":";
+                    key += ctx.port ? std::to_string(ctx.port) : service;
+                    key += '\0';
+                    key += cacert ? cacert : "";
+                    SSLSessionCache::instance().apply(ssl, key);
+                }
                 auto param = SSL_get0_param(ssl);
                 if (!X509_VERIFY_PARAM_add1_host(param, host, 0)) {
                     if (!has_ssl) SSL_free(ssl);
@@ -315,18 +520,22 @@ namespace socklib {
                     ctx.err = TCPError::cert_verify_failed;
                     return false;
                 }
+                X509_free(verify);
+                if (!has_ctx) {
+                    SSLSessionCache::instance().record(ssl);
+                }
                 return true;
             }
 
            public:
             template <class C>
             static bool setupssl(int sock, SSL_CTX*& sslctx, SSL*& ssl, TCPOpenContext<C*>& ctx, CancelContext* cancel) {
-                return setupssl_detail(sock, sslctx, ssl, ctx, ctx.host, ctx.cacert, cancel);
+                return setupssl_detail(sock, sslctx, ssl, ctx, ctx.host, ctx.service, ctx.cacert, cancel);
             }
 
             template <class Str>
             static bool setupssl(int sock, SSL_CTX*& sslctx, SSL*& ssl, TCPOpenContext<Str>& ctx, CancelContext* cancel) {
-                return setupssl_detail(sock, sslctx, ssl, ctx, ctx.host.c_str(), ctx.cacert.c_str(), cancel);
+                return setupssl_detail(sock, sslctx, ssl, ctx, ctx.host.c_str(), ctx.service.c_str(), ctx.cacert.c_str(), cancel);
             }
         };
 
@@ -452,6 +661,183 @@ namespace socklib {
                 return true;
             }
 
+            static bool init_ssl(TCPAcceptContext<String>& ctx) {
+                if (ctx.sslctx) {
+                    return true;
+                }
+                auto cert = get_data(ctx.servercert);
+                auto key = get_data(ctx.serverkey);
+                if (!cert || !*cert) {
+                    ctx.err = TCPError::cert_not_found;
+                    return false;
+                }
+                if (!key || !*key) {
+                    key = cert;
+                }
+                SSLCtxError err = SSLCtxError::none;
+                auto sslctx = SSLCtxCache::instance().get_server(cert, key, ctx.alpnstr, ctx.len, ctx.ticket_rotation_sec, &err);
+                if (!sslctx) {
+                    ctx.err = err == SSLCtxError::certificate ? TCPError::load_certificate : TCPError::memory;
+                    return false;
+                }
+                ctx.sslctx = sslctx;
+                return true;
+            }
+
+            //step handshake h
+            //returns 1 if completed, 0 if in progress and -1 if failed
+            static int step_handshake(TLSHandshake& h) {
+                auto res = ::SSL_do_handshake(h.ssl);
+                if (res == 1) {
+                    return 1;
+                }
+                auto err = ::SSL_get_error(h.ssl, res);
+                if (err == SSL_ERROR_WANT_READ || err == SSL_ERROR_WANT_WRITE) {
+                    h.want_write = err == SSL_ERROR_WANT_WRITE;
+                    return 0;
+                }
+                return -1;
+            }
+
+            static void drop_handshake(TLSHandshake& h) {
+                ::SSL_free(h.ssl);
+                ::closesocket(h.sock);
+                h.ssl = nullptr;
+                h.sock = invalid_socket;
+            }
+
+            //accept one connection from listening socket and start its handshake
+            static bool start_handshake(TCPAcceptContext<String>& ctx) {
+                TLSHandshake h;
+                h.addrlen = sizeof(h.addr);
+                h.sock = ::accept(ctx.acsock, (::sockaddr*)&h.addr, &h.addrlen);
+                if (h.sock < 0) {
+                    return false;
+                }
+                u_long l = 1;
+                ::ioctlsocket(h.sock, FIONBIO, &l);
+                if (ctx.no_delay) {
+                    set_no_delay(h.sock);
+                }
+                h.ssl = ::SSL_new(ctx.sslctx);
+                if (!h.ssl) {
+                    ::closesocket(h.sock);
+                    return false;
+                }
+                ::SSL_set_fd(h.ssl, (int)h.sock);
+                if (ctx.ktls) {
+                    enable_ktls(h.ssl);
+                }
+                ::SSL_set_accept_state(h.ssl);
+                h.deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(ctx.handshake_timeout_msec);
+                ctx.handshakes.push_back(h);
+                return true;
+            }
+
+            //wait until any handshake of accepted connection is completed
+            //listening socket and sockets in handshake are polled together, and failed or timed out handshakes are dropped
+            static bool wait_handshake(TLSHandshake& done, TCPAcceptContext<String>& ctx, CancelContext* cancel = nullptr) {
+                std::vector<pollfd_t> fds;
+                while (true) {
+                    auto now = std::chrono::steady_clock::now();
+                    for (auto it = ctx.handshakes.begin(); it != ctx.handshakes.end();) {
+                        if (it->deadline <= now) {
+                            drop_handshake(*it);
+                            it = ctx.handshakes.erase(it);
+                            continue;
+                        }
+                        it++;
+                    }
+                    bool accepting = ctx.handshakes.size() < ctx.max_handshakes;
+                    fds.clear();
+                    for (auto& h : ctx.handshakes) {
+                        pollfd_t fd = {0};
+                        fd.fd = h.sock;
+                        fd.events = h.want_write ? POLLOUT : POLLIN;
+                        fds.push_back(fd);
+                    }
+                    if (accepting) {
+                        pollfd_t fd = {0};
+                        fd.fd = ctx.acsock;
+                        fd.events = POLLIN;
+                        fds.push_back(fd);
+                    }
+                    int msec = io_wait_slice_msec;
+                    if (cancel) {
+                        auto rem = cancel->remaining_msec();
+                        if (rem >= 0 && rem < msec) {
+                            msec = (int)rem;
+                        }
+                    }
+                    auto res = poll_fds(fds.data(), fds.size(), msec);
+                    if (res < 0) {
+                        ctx.err = TCPError::wait_accept;
+                        return false;
+                    }
+                    if (accepting && fds.back().revents && start_handshake(ctx)) {
+                        //ClientHello may have arrived already, so step it without waiting
+                        pollfd_t fd = {0};
+                        fd.fd = ctx.handshakes.back().sock;
+                        fd.revents = POLLIN;
+                        fds.insert(fds.end() - 1, fd);
+                    }
+                    for (size_t i = 0; i < ctx.handshakes.size(); i++) {
+                        if (!fds[i].revents) {
+                            continue;
+                        }
+                        auto& h = ctx.handshakes[i];
+                        auto step = step_handshake(h);
+                        if (step == 0) {
+                            continue;
+                        }
+                        if (step < 0) {
+                            drop_handshake(h);
+                        }
+                        else {
+                            done = h;
+                        }
+                        ctx.handshakes.erase(ctx.handshakes.begin() + i);
+                        if (step > 0) {
+                            return true;
+                        }
+                        fds.erase(fds.begin() + i);
+                        i--;
+                    }
+                    if (cancel && cancel->on_cancel()) {
+                        ctx.err = TCPError::canceled;
+                        return false;
+                    }
+                }
+            }
+
+            static bool accept_ssl(SOCKET sock, ::SSL*& ssl, TCPAcceptContext<String>& ctx, CancelContext* cancel = nullptr) {
+                ssl = ::SSL_new(ctx.sslctx);
+                if (!ssl) {
+                    ctx.err = TCPError::memory;
+                    return false;
+                }
+                ::SSL_set_fd(ssl, (int)sock);
+                if (ctx.ktls) {
+                    enable_ktls(ssl);
+                }
+                while (true) {
+                    auto res = ::SSL_accept(ssl);
+                    if (res == 1) {
+                        return true;
+                    }
+                    auto err = ::SSL_get_error(ssl, res);
+                    if (err == SSL_ERROR_WANT_READ || err == SSL_ERROR_WANT_WRITE) {
+                        if (wait_io(sock, err == SSL_ERROR_WANT_WRITE, cancel) == WaitResult::ready) {
+                            continue;
+                        }
+                    }
+                    ::SSL_free(ssl);
+                    ssl = nullptr;
+                    ctx.err = TCPError::ssl_accept;
+                    return false;
+                }
+            }
+
             static bool wait_signal(TCPAcceptContext<String>& ctx, CancelContext* cancel = nullptr) {
                 if (ctx.acsock == invalid_socket) {
                     ctx.err = TCPError::no_socket;
@@ -518,6 +904,9 @@ namespace socklib {
                         })) {
                     return not_reopen;
                 }
+                if (ctx.no_delay) {
+                    set_no_delay(sock);
+                }
                 if (ctx.stat.type == ConnType::tcp_socket) {
                     if (res) {
                         SocketReset reset;
@@ -526,16 +915,15 @@ namespace socklib {
                         res->reset(reset);
                     }
                     else {
-                        res = std::make_shared<StreamConn>(sock, selected);
+                        auto conn = std::make_shared<StreamConn>(sock, selected);
+                        conn->set_recvbuf_size(ctx.recvbuf_size);
+                        res = std::move(conn);
                     }
                 }
                 else {
                     ::SSL* ssl = nullptr;
+                    //SSL_CTX is taken from SSLCtxCache (not from res) because ALPN may differ from previous connection
                     ::SSL_CTX* sslctx = nullptr;
-                    if (res) {
-                        //ssl = stat.net.ssl;
-                        sslctx = stat.net.ssl_ctx;
-                    }
                     if (any(ctx.stat.status & ConnStatus::secure)) {
                         if (!SecureSetter::setupssl(sock, sslctx, ssl, ctx, cancel)) {
                             ::freeaddrinfo(info);
@@ -549,11 +937,12 @@ namespace socklib {
                         reset.sock = sock;
                         reset.ssl = ssl;
                         reset.ctx = sslctx;
-                        reset.delflag = DelFlag::not_del_ctx;
                         res->reset(reset);
                     }
                     else {
-                        res = std::make_shared<SecureStreamConn>(ssl, sslctx, sock, selected);
+                        auto conn = std::make_shared<SecureStreamConn>(ssl, sslctx, sock, selected);
+                        conn->set_recvbuf_size(ctx.recvbuf_size);
+                        res = std::move(conn);
                     }
                 }
                 ::freeaddrinfo(info);
@@ -564,6 +953,13 @@ namespace socklib {
                 if (!ServerHandler<String>::init_server(ctx)) {
                     return nullptr;
                 }
+                bool secure = any(ctx.stat.status & ConnStatus::secure);
+                if (secure && !ServerHandler<String>::init_ssl(ctx)) {
+                    return nullptr;
+                }
+                if (secure && ctx.nonblock_handshake) {
+                    return accept_handshaked(ctx, cancel);
+                }
                 if (!ServerHandler<String>::wait_signal(ctx, cancel)) {
                     return nullptr;
                 }
@@ -585,7 +981,47 @@ namespace socklib {
                     u_long l = 1;
                     ::ioctlsocket(sock, FIONBIO, &l);
                 }
-                return std::make_shared<StreamConn>(sock, &remote_info);
+                if (ctx.no_delay) {
+                    set_no_delay(sock);
+                }
+                if (secure) {
+                    ::SSL* ssl = nullptr;
+                    if (!ServerHandler<String>::accept_ssl(sock, ssl, ctx, cancel)) {
+                        ::closesocket(sock);
+                        return nullptr;
+                    }
+                    //each connection holds a reference to ctx.sslctx
+                    ::SSL_CTX_up_ref(ctx.sslctx);
+                    auto conn = std::make_shared<SecureStreamConn>(ssl, ctx.sslctx, sock, &remote_info);
+                    conn->set_recvbuf_size(ctx.recvbuf_size);
+                    return conn;
+                }
+                auto conn = std::make_shared<StreamConn>(sock, &remote_info);
+                conn->set_recvbuf_size(ctx.recvbuf_size);
+                return conn;
+            }
+
+           private:
+            static std::shared_ptr<InetConn> accept_handshaked(TCPAcceptContext<String>& ctx, CancelContext* cancel) {
+                TLSHandshake h;
+                if (!ServerHandler<String>::wait_handshake(h, ctx, cancel)) {
+                    return nullptr;
+                }
+                if (!ctx.non_block) {
+                    u_long l = 0;
+                    ::ioctlsocket(h.sock, FIONBIO, &l);
+                }
+                ::addrinfo remote_info = {0};
+                remote_info.ai_family = h.addr.ss_family;
+                remote_info.ai_socktype = SOCK_STREAM;
+                remote_info.ai_protocol = IPPROTO_TCP;
+                remote_info.ai_addrlen = h.addrlen;
+                remote_info.ai_addr = (::sockaddr*)&h.addr;
+                //each connection holds a reference to ctx.sslctx
+                ::SSL_CTX_up_ref(ctx.sslctx);
+                auto conn = std::make_shared<SecureStreamConn>(h.ssl, ctx.sslctx, h.sock, &remote_info);
+                conn->set_recvbuf_size(ctx.recvbuf_size);
+                return conn;
             }
         };
     }  // namespace v2
@@ -135,24 +135,25 @@ namespace socklib {
                 }
                 else {
                     w.template write_as<std::uint8_t>(127 | mmask);
-                    w.write_hton((std::uint8_t)size);
+                    w.write_hton((std::uint64_t)size);
                 }
+                GatherWriteContext c;
+                string_t masked;
                 if (maskkey) {
-                    std::uint8_t key = commonlib2::translate_byte_net_and_host<std::uint8_t>(&maskkey);
+                    std::uint32_t key = commonlib2::translate_byte_net_and_host<std::uint32_t>(maskkey);
                     char* k = reinterpret_cast<char*>(&key);
                     w.write_byte(k, 4);
                     if (size) {
-                        string_t masked(data, size);
+                        masked = string_t(data, size);
                         mask(masked, *maskkey);
-                        w.write_byte(masked);
                     }
+                    c.add(w.get().data(), w.get().size());
+                    c.add(masked.data(), masked.size());
                 }
-                else if (size) {
-                    w.write_byte(data, size);
+                else {
+                    c.add(w.get().data(), w.get().size());
+                    c.add(data, size);
                 }
-                WriteContext c;
-                c.ptr = w.get().data();
-                c.bufsize = w.get().size();
                 return conn->write(c, cancel);
             }
 
@@ -7,6 +7,7 @@
 
 #pragma once
 #include "tcp_socket.h"
+#include "../common/ssl_ctx_cache.h"
 
 namespace socklib {
     namespace v3 {
@@ -192,15 +193,21 @@ namespace socklib {
                     }
                     case 1: {
                         if (!ctx->ctx) {
-                            ctx->ctx = SSL_CTX_new(TLS_method());
+                            //alpn is set on each SSL, so SSL_CTX is shared by all connections of same cacert
+                            SSLCtxError err = SSLCtxError::none;
+                            ctx->ctx = SSLCtxCache::instance().get(ctx->cacert, nullptr, 0, SSL_VERIFY_NONE, &err);
                             if (!ctx->ctx) {
-                                call_ssl_error("failed to make SSL_CTX.\n");
+                                if (err == SSLCtxError::cacert) {
+                                    call_ssl_error("faild call ::SSL_CTX_load_verify_locations\n");
+                                }
+                                else {
+                                    call_ssl_error("failed to make SSL_CTX.\n");
+                                }
                                 ctx = nullptr;
                                 return false;
                             }
-                            SSL_CTX_set_options(ctx->ctx, SSL_OP_NO_SSLv2);
                         }
-                        if (!::SSL_CTX_load_verify_locations(ctx->ctx, ctx->cacert, nullptr)) {
+                        else if (!::SSL_CTX_load_verify_locations(ctx->ctx, ctx->cacert, nullptr)) {
                             call_ssl_error("faild call ::SSL_CTX_load_verify_locations\n");
                             ctx = nullptr;
                             return false;
@@ -257,6 +264,11 @@ namespace socklib {
                                 ctx = nullptr;
                                 return false;
                             }
+                            //port is not known here, so sessions are shared by all ports of host
+                            std::string key = ctx->hostname;
+                            key += '\0';
+                            key += ctx->cacert ? ctx->cacert : "";
+                            SSLSessionCache::instance().apply(ctx->ssl, key);
                         }
                         ::SSL_set0_rbio(ctx->ssl, ctx->io_ssl);
                         ::SSL_set0_wbio(ctx->ssl, ctx->io_ssl);
@@ -274,6 +286,7 @@ namespace socklib {
                             ctx = nullptr;
                             return e;
                         }
+                        SSLSessionCache::instance().record(ctx->ssl);
                     default:
                         ctx->report(nullptr);
                         ctx = nullptr;
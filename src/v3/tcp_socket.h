@@ -7,6 +7,7 @@
 
 #pragma once
 #include "dns.h"
+#include "../common/io_wait.h"
 #include <memory>
 #include <string>
 #include <basic_helper.h>
@@ -32,6 +33,8 @@ namespace socklib {
             ::addrinfo* current = nullptr;
             ::SOCKET tmp = invalid_socket;
             int ip_version = 0;
+            //max milliseconds to block in one connect progress
+            int connect_wait_msec = 100;
         };
 
         struct TCPConn : Conn {
@@ -77,36 +80,36 @@ namespace socklib {
                             ctx->tmp = invalid_socket;
                             return true;
                         }
-                        ctx->increment();
-                    case 5: {
-                        ::timeval timeout = {0};
-                        ::fd_set baseset = {0}, sucset = {0}, errset = {0};
-                        FD_ZERO(&baseset);
-                        FD_SET(ctx->tmp, &baseset);
-                        memcpy(&sucset, &baseset, sizeof(::fd_set));
-                        memcpy(&errset, &baseset, sizeof(::fd_set));
-                        timeout.tv_usec = 1;
-                        auto res = ::select(ctx->tmp + 1, nullptr, &sucset, &errset, &timeout);
-                        if (res < 0) {
+                        if (!connect_in_progress()) {
                             ::closesocket(ctx->tmp);
                             ctx->tmp = invalid_socket;
-                            ctx->report("connect failed on select() calling. ", get_socket_error());
+                            ctx->report("connect failed on ::connect() calling. ", get_socket_error());
                             append_host_service();
                             return false;
                         }
-                        if (FD_ISSET(ctx->tmp, &errset)) {
+                        ctx->increment();
+                    case 5: {
+                        auto res = wait_io_once(ctx->tmp, true, ctx->connect_wait_msec);
+                        if (res == WaitResult::timeout) {
+                            return StateValue::inprogress;
+                        }
+                        if (res == WaitResult::failed) {
                             ::closesocket(ctx->tmp);
                             ctx->tmp = invalid_socket;
-                            ctx->report("connect failed on FD_ISSET(&errset) calling. ");
+                            ctx->report("connect failed on poll() calling. ", get_socket_error());
                             append_host_service();
                             return false;
                         }
-                        if (FD_ISSET(ctx->tmp, &sucset)) {
-                            ctx->sock = ctx->tmp;
+                        if (auto err = connect_error(ctx->tmp); err != 0) {
+                            ::closesocket(ctx->tmp);
                             ctx->tmp = invalid_socket;
-                            return true;
+                            ctx->report("connect failed. ", err);
+                            append_host_service();
+                            return false;
                         }
-                        return StateValue::inprogress;
+                        ctx->sock = ctx->tmp;
+                        ctx->tmp = invalid_socket;
+                        return true;
                     }
                 }
             }
@@ -156,7 +159,7 @@ namespace socklib {
                     case 3:
                     case 4:
                     case 5:
-                        if (auto e = connect(m); e = StateValue::inprogress) {
+                        if (auto e = connect(m); e == StateValue::inprogress) {
                             return e;
                         }
                         else if (!e) {